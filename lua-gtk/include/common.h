@@ -110,9 +110,18 @@ struct array_info {
     unsigned char dim[2];	    // [1] is zero for one-dimensional arrays
 };
 
+/* Hash value of the full name of a native type, e.g. "GtkWidget*".  Each
+ * module has a list of these sorted by hash value, so that it can be merged
+ * into the core module's type map; a zero type_idx ends the list. */
+struct type_hash {
+    unsigned int hash_value;
+    unsigned int type_idx;
+};
+
 
 /* Information about a C function in the shared library.  This structure
  * is filled before calling lg_call. */
+struct call_plan;
 struct func_info {
     void *func;			/* address of the function */
     const char *name;		/* full name in dynamic library;
@@ -120,6 +129,7 @@ struct func_info {
     int module_idx;		/* which module this is in */
     const unsigned char *args_info;
     int args_len;
+    struct call_plan *plan;	/* decoded args_info, set by lg_call */
 };
 
 
@@ -183,7 +193,7 @@ struct dynlink {
  * Size: 5*4 bytes = 20 on 32 bit, 28 byte on 64 bit architectures.
  */
 struct object {
-    void *p;			/* addr of the object & key to "objects" tbl */
+    void *p;			/* addr of the object & key in the object map */
     typespec_t ts;		/* the type of the library object */
     unsigned int
 	mm_type : 8,		/* how memory management is done */
@@ -224,6 +234,7 @@ typedef enum {
 #define FLAG_ARRAY_ELEMENT 0x0800
 #define FLAG_CHAR_PTR 0x1000
 #define FLAG_CONST_CHAR_PTR 0x2000
+#define FLAG_VALUE 0x4000	    // structure stored in the proxy object
 
 typedef int (*object_handler)(struct object*, object_op, int);
 
@@ -282,7 +293,15 @@ struct module_info {
     int *fundamental_map;			// see below
     int module_idx;				// index given to this module
     struct dynlink dynlink;
-    int module_ref;				// ref to the module's table
+
+    // The following fields are only used for API version 0.14 and later;
+    // earlier versions had the field module_ref before them.
+
+    // added in API version 0.12
+    const unsigned char *elem_sorted;		// elem_list index by name
+
+    // added in API version 0.13
+    const struct type_hash *type_hash;		// native types by hash value
 };
 
 // macros to emit translatable messages
@@ -321,6 +340,7 @@ struct lg_enum_t {
 #define RUNTIME_VALGRIND	    16	/* valgrind friendly */
 #define RUNTIME_DEBUG_CLOSURES	    32	/* don't free closures until end */
 #define RUNTIME_PROFILE		    64	/* runtime profiling */
+#define RUNTIME_NO_FAST_CALLS	    128	/* always call through libffi */
 
 #ifdef RUNTIME_LINKING
 #include "link.h"
@@ -58,6 +58,6 @@ struct lg_module_api {
 	const char *name);		/* added 2010-02-19 */
 };
 #define LUAGNOME_MODULE_MAJOR 0
-#define LUAGNOME_MODULE_MINOR 11
+#define LUAGNOME_MODULE_MINOR 14
 
 
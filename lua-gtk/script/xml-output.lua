@@ -73,6 +73,7 @@ end
 local string_buf = {}	-- name => { tbl, buf, offsets, offset }
 
 local elem_start = 0	-- current position in the element table
+local elem_sorted = {}	-- name index of the elements, see output_one_struct
 
 ---
 -- Add another string to the string table and return the offset.  If the string
@@ -148,6 +149,7 @@ end
 function output_one_struct(ofile, tp, struct_name)
     local st, member, ofs
     local ignore_xml_tags = types.ignore_xml_tags
+    local names = {}
     st = tp.struct
 
     -- already stored?
@@ -215,11 +217,26 @@ function output_one_struct(ofile, tp, struct_name)
 		struct_name, member.name or member_name)
 	    ofile:write(s)
 
+	    names[#names + 1] = member.name or member_name
 	    elem_start = elem_start + 1
 	end
     end
 
     st.elem_count = elem_start - st.elem_start
+
+    -- Index of the elements sorted by name, so that find_attribute can use
+    -- a binary search.  For each element of elem_list, elem_sorted has the
+    -- position (relative to elem_start) of the n-th name in sorted order.
+    -- Equal names keep their order, so the first one is found.
+    local order = {}
+    for i = 1, #names do order[i] = i end
+    table.sort(order, function(a, b)
+	if names[a] ~= names[b] then return names[a] < names[b] end
+	return a < b
+    end)
+    for _, i in ipairs(order) do
+	elem_sorted[#elem_sorted + 1] = i - 1
+    end
 end
 
 file_to_module = {}
@@ -279,6 +296,7 @@ function output_types(ofname)
     -- Generate the list of struct/union elements for types that are
     -- "native" to this module.
     elem_start = 0
+    elem_sorted = {}
     header("extern const struct struct_elem %selem_list[];", config.prefix)
     ofile:write(string.format("const struct struct_elem %selem_list[] = {\n",
 	config.prefix))
@@ -297,6 +315,15 @@ function output_types(ofname)
     end
     ofile:write("};\n\n")
 
+    -- the name index of the structure elements; 8 bits as elem_count.
+    header("extern const unsigned char %selem_sorted[];", config.prefix)
+    ofile:write(string.format("const unsigned char %selem_sorted[] = {",
+	config.prefix))
+    for i, v in ipairs(elem_sorted) do
+	ofile:write((i % 20 == 1) and "\n " or "", v, ",")
+    end
+    ofile:write("\n 0 };\n\n")
+
     -- type_list.
     header("extern const union type_info %stype_list[];", config.prefix)
     ofile:write(string.format("const union type_info %stype_list[] = {\n"
@@ -383,6 +410,8 @@ function output_types(ofname)
 
     ofile:write(string.format("};\n\n"))
 
+    _output_type_hash(ofile, keys)
+
     -- write that later into the .h file
     -- header("#define TYPE_COUNT %d", #keys)
     config.type_count = #keys
@@ -404,6 +433,37 @@ function output_types(ofname)
 	types_native, types_native_strings, types_foreign))
 end
 
+---
+-- Write the hash values of the full names of all native types, sorted by
+-- hash value.  The core module merges this list into its type map when the
+-- module is loaded, which saves hashing each type name at runtime.
+--
+function _output_type_hash(ofile, keys)
+    local list, seen = {}, {}
+
+    for i, full_name in ipairs(keys) do
+	local t = typedefs[typedefs_name2id[full_name]]
+	if t.is_native then
+	    local hash_value = gnomedev.compute_hash(full_name)
+	    assert(not seen[hash_value], "hash collision between types "
+		.. full_name .. " and " .. (seen[hash_value] or ""))
+	    seen[hash_value] = full_name
+	    list[#list + 1] = { hash_value, t.type_idx, full_name }
+	end
+    end
+
+    table.sort(list, function(a, b) return a[1] < b[1] end)
+
+    header("extern const struct type_hash %stype_hash[];", config.prefix)
+    ofile:write(string.format("const struct type_hash %stype_hash[] = {\n",
+	config.prefix))
+    for i, v in ipairs(list) do
+	ofile:write(string.format(" { 0x%08x, %d }, /* %s */\n", v[1], v[2],
+	    v[3]))
+    end
+    ofile:write(" { 0, 0 }\n};\n\n")
+end
+
 ---
 -- The type t is an array.  Append another line to the array_list.
 function _add_array(array_list, t)
@@ -617,6 +677,8 @@ function _generate_module_info()
     header('    name: "%s",', modname)
     header('    type_list: %s_type_list,', modname)
     header('    elem_list: %s_elem_list,', modname)
+    header('    elem_sorted: %s_elem_sorted,', modname)
+    header('    type_hash: %s_type_hash,', modname)
     header('    type_count: %d,', config.type_count)    -- set in output_types
     header('    fundamental_hash: %s_fundamental_hash,', modname)
     header('    fundamental_count: %d,', config.fundamental_count)
@@ -7,6 +7,7 @@
  *   glib_connect
  *   glib_connect_after
  *   glib_disconnect
+ *   glib_signal_set_dispatch
  */
 
 /**
@@ -23,17 +24,47 @@
 // use this for older FFI versions doesn't detect existing functions!
 // #define ffi_closure_alloc(x,y) g_malloc(x)
 
+/* How to push a signal argument; determined once in _connect. */
+enum arg_kind {
+    ARG_GVALUE = 0,		/* generic: collect into a GValue */
+    ARG_INT,
+    ARG_UINT,
+    ARG_LONG,
+    ARG_ULONG,
+    ARG_BOOLEAN,
+    ARG_FLOAT,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_OBJECT,			/* derived from GObject */
+};
+
+/* bits in flags */
+#define CB_QUERY_TOOLTIP 1	/* argument #4 must be released after the
+				   call, see _callback */
+
 /* one such structure per connected callback */
 struct callback_info {
     int handler_ref;		/* reference to the function to call */
-    int args_ref;		/* reference to a table with additional args */
+    int args_ref;		/* reference to an array with additional args */
+    int args_count;		/* number of additional args */
     int object_ref;		/* reference to the object: avoids GC */
     lua_State *L;		/* the Lua state this belongs to */
     GSignalQuery query;		/* information about the signal, see below */
+    GType return_type;		/* without G_SIGNAL_TYPE_STATIC_SCOPE */
+    unsigned int flags;
+    unsigned char arg_kind[];	/* enum arg_kind; query.n_params entries */
 };
 /* query: signal_id, signal_name, itype, signal_flags, return_type, n_params,
  * param_types */
 
+#define CALLBACK_INFO_SIZE(n_params) (sizeof(struct callback_info) \
+    + (n_params) * sizeof(unsigned char))
+
+/* How signal handlers are called, see glib_signal_set_dispatch. */
+#define DISPATCH_CLOSURE 0	/* GClosure with _closure_marshal */
+#define DISPATCH_VARARGS 1	/* C callback _callback */
+static int dispatch_mode = DISPATCH_CLOSURE;
+
 
 static void _callback_type_error(lua_State *L, struct callback_info *cbi,
     int is_type, int expected_type)
@@ -127,92 +158,63 @@ asm(
 #endif
 
 /**
- * Handler for Gtk signal callbacks.  Find the proper Lua callback, build the
- * parameters, call, and optionally return something to Gtk.  This runs in the
- * lua_State that was used to call glib_connect with, and therefore probably
- * uses the stack of the main function, which mustn't be modified.
+ * Push the Lua handler of a signal, and the object as its first argument.
  *
- * @param data   a pointer to a struct callback_info
- * @param ...    Variable arguments, and finally the object pointer.
- * @return       A value to return to Gtk.
+ * @return  The object.
  */
-static int _callback(void *data, ...)
+static struct object *_callback_push_handler(lua_State *L,
+    struct callback_info *cbi)
 {
-    va_list ap;
-    int i, arg_cnt, return_count, extra_args=0;
-    struct callback_info *cbi = (struct callback_info*) data;
-    lua_State *L = cbi->L;
-    int stack_top = lua_gettop(L);
-
     /* get the handler function */
     lua_rawgeti(L, LUA_REGISTRYINDEX, cbi->handler_ref);
     if (lua_isnil(L, -1)) {
 	lua_pop(L, 1);
-	return luaL_error(L, "%s callback handler not found.", api->msgprefix);
+	luaL_error(L, "%s callback handler not found.", api->msgprefix);
     }
 
     /* first parameter: the object */
     lua_rawgeti(L, LUA_REGISTRYINDEX, cbi->object_ref);
     if (lua_isnil(L, -1)) {
 	lua_pop(L, 2);
-	return luaL_error(L, "%s callback object not found.", api->msgprefix);
-    }
-    struct object *w = (struct object*) lua_touserdata(L, -1);
-
-    /* push all the signal arguments to the Lua stack */
-    arg_cnt = cbi->query.n_params;
-
-    // retrieve the additional parameters using the stdarg mechanism.
-    va_start(ap, data);
-    GValue gv = { 0 };
-    for (i=0; i<arg_cnt; i++) {
-	GType type = cbi->query.param_types[i] & ~G_SIGNAL_TYPE_STATIC_SCOPE;
-	gchar *err_msg = NULL;
-
-	g_value_init(&gv, type);
-	G_VALUE_COLLECT(&gv, ap, G_VALUE_NOCOPY_CONTENTS, &err_msg);
-	if (err_msg)
-	    return luaL_error(L, "%s vararg %d failed: %s", api->msgprefix, i+1,
-		err_msg);
-	api->push_gvalue(L, &gv);
-	g_value_unset(&gv);
+	luaL_error(L, "%s callback object not found.", api->msgprefix);
     }
+    return (struct object*) lua_touserdata(L, -1);
+}
 
-    /* The object is the last parameter to this function.  The Lua callback
-     * gets it as the first parameter, though, so it isn't really used. */
-    void *object = va_arg(ap, void*);
-    if (object != w->p) {
-	fprintf(stderr, "Warning: _callback on different object: %p %p\n",
-	    w->p, object);
-    }
-    va_end(ap);
 
+/**
+ * The handler, the object and the signal arguments have been pushed.  Add
+ * the extra arguments, call the handler and restore the stack.
+ *
+ * @param stack_top  Stack top before pushing the handler
+ * @return  The value to return to Gtk.
+ */
+static int _callback_call(lua_State *L, struct callback_info *cbi,
+    int stack_top)
+{
+    int i, arg_cnt = cbi->query.n_params, return_count;
 
     /* copy all the extra arguments (user provided) to the stack. */
-    if (cbi->args_ref) {
+    if (cbi->args_count) {
 	lua_rawgeti(L, LUA_REGISTRYINDEX, cbi->args_ref);
-	lua_pushnil(L);
-	// stack: ..., argstable, key
-	while (lua_next(L, -2) != 0) {
-	    lua_insert(L, -3);
-	    extra_args ++;
-	}
-	lua_pop(L, 1);
+	for (i=1; i<=cbi->args_count; i++)
+	    lua_rawgeti(L, stack_top + arg_cnt + 3, i);
+	lua_remove(L, stack_top + arg_cnt + 3);
     }
 
     /* determine whether a return value is expected */
-    GType return_type = cbi->query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE;
+    GType return_type = cbi->return_type;
     return_count = (return_type == G_TYPE_NONE) ? 0 : 1;
 
     struct object *delete_o = NULL;
 
     /* extra hack */
-    if (!strcmp(cbi->query.signal_name, "query-tooltip"))
+    if (cbi->flags & CB_QUERY_TOOLTIP)
 	// argument #5 is the GtkTooltip, which must be released NOW.
 	delete_o = (struct object*) lua_touserdata(L, stack_top + 6);
 
     /* Call the callback! */
-    lua_call(L, arg_cnt+extra_args+1, return_count);
+    lua_call(L, arg_cnt+cbi->args_count+1, return_count);
 
     /* Determine the return value (default is zero) */
     int val = _callback_return_value(L, return_type, cbi);
@@ -231,6 +233,181 @@ static int _callback(void *data, ...)
     return val;
 }
 
+
+/**
+ * Handler for Gtk signal callbacks.  Find the proper Lua callback, build the
+ * parameters, call, and optionally return something to Gtk.  This runs in the
+ * lua_State that was used to call glib_connect with, and therefore probably
+ * uses the stack of the main function, which mustn't be modified.
+ *
+ * This is used in the DISPATCH_VARARGS mode.
+ *
+ * @param data   a pointer to a struct callback_info
+ * @param ...    Variable arguments, and finally the object pointer.
+ * @return       A value to return to Gtk.
+ */
+static int _callback(void *data, ...)
+{
+    va_list ap;
+    int i, arg_cnt;
+    struct callback_info *cbi = (struct callback_info*) data;
+    lua_State *L = cbi->L;
+    int stack_top = lua_gettop(L);
+    struct object *w = _callback_push_handler(L, cbi);
+
+    /* push all the signal arguments to the Lua stack */
+    arg_cnt = cbi->query.n_params;
+
+    // retrieve the additional parameters using the stdarg mechanism.  The
+    // common types are pushed directly; they are collected like
+    // G_VALUE_COLLECT would do.
+    va_start(ap, data);
+    for (i=0; i<arg_cnt; i++) {
+	switch (cbi->arg_kind[i]) {
+	    case ARG_INT:
+		lua_pushnumber(L, va_arg(ap, gint));
+		break;
+
+	    case ARG_UINT:
+		lua_pushnumber(L, va_arg(ap, guint));
+		break;
+
+	    case ARG_LONG:
+		lua_pushnumber(L, va_arg(ap, glong));
+		break;
+
+	    case ARG_ULONG:
+		lua_pushnumber(L, va_arg(ap, gulong));
+		break;
+
+	    case ARG_BOOLEAN:
+		lua_pushboolean(L, va_arg(ap, gint));
+		break;
+
+	    // floats are promoted to double
+	    case ARG_FLOAT:
+	    case ARG_DOUBLE:
+		lua_pushnumber(L, va_arg(ap, gdouble));
+		break;
+
+	    case ARG_STRING:
+		lua_pushstring(L, va_arg(ap, gchar*));
+		break;
+
+	    case ARG_OBJECT:;
+		typespec_t ts = { 0 };
+		// pushes nil for NULL and on error.
+		api->get_object(L, va_arg(ap, gpointer), ts,
+		    FLAG_NOT_NEW_OBJECT);
+		break;
+
+	    default:;
+		GType type = cbi->query.param_types[i]
+		    & ~G_SIGNAL_TYPE_STATIC_SCOPE;
+		GValue gv = { 0 };
+		gchar *err_msg = NULL;
+
+		g_value_init(&gv, type);
+		G_VALUE_COLLECT(&gv, ap, G_VALUE_NOCOPY_CONTENTS, &err_msg);
+		if (err_msg)
+		    return luaL_error(L, "%s vararg %d failed: %s",
+			api->msgprefix, i+1, err_msg);
+		api->push_gvalue(L, &gv);
+		g_value_unset(&gv);
+	}
+    }
+
+    /* The object is the last parameter to this function.  The Lua callback
+     * gets it as the first parameter, though, so it isn't really used. */
+    void *object = va_arg(ap, void*);
+    if (object != w->p) {
+	fprintf(stderr, "Warning: _callback on different object: %p %p\n",
+	    w->p, object);
+    }
+    va_end(ap);
+
+    return _callback_call(L, cbi, stack_top);
+}
+
+
+/**
+ * Marshaller of the GClosure used for signal handlers in the
+ * DISPATCH_CLOSURE mode.  GLib passes the arguments as an array of GValues,
+ * so they needn't be collected from a va_list, and no architecture specific
+ * code is required.
+ *
+ * @param closure  The closure; its data is the struct callback_info
+ * @param return_value  Location for the return value, or NULL
+ * @param n_param_values  Number of values in param_values
+ * @param param_values  The object, followed by the signal arguments
+ */
+static void _closure_marshal(GClosure *closure, GValue *return_value,
+    guint n_param_values, const GValue *param_values,
+    gpointer invocation_hint, gpointer marshal_data)
+{
+    struct callback_info *cbi = (struct callback_info*) closure->data;
+    lua_State *L = cbi->L;
+    int i, val, stack_top = lua_gettop(L);
+    const GValue *gv;
+
+    // param_values[0] is the object, which is pushed from the reference.
+    _callback_push_handler(L, cbi);
+
+    for (i=0; i<cbi->query.n_params; i++) {
+	gv = param_values + i + 1;
+	switch (cbi->arg_kind[i]) {
+	    case ARG_INT:
+		lua_pushnumber(L, gv->data[0].v_int);
+		break;
+
+	    case ARG_BOOLEAN:
+		lua_pushboolean(L, gv->data[0].v_int);
+		break;
+
+	    case ARG_UINT:
+		lua_pushnumber(L, gv->data[0].v_uint);
+		break;
+
+	    case ARG_LONG:
+		lua_pushnumber(L, gv->data[0].v_long);
+		break;
+
+	    case ARG_ULONG:
+		lua_pushnumber(L, gv->data[0].v_ulong);
+		break;
+
+	    case ARG_FLOAT:
+		lua_pushnumber(L, gv->data[0].v_float);
+		break;
+
+	    case ARG_DOUBLE:
+		lua_pushnumber(L, gv->data[0].v_double);
+		break;
+
+	    case ARG_STRING:
+		lua_pushstring(L, (const char*) gv->data[0].v_pointer);
+		break;
+
+	    case ARG_OBJECT:;
+		typespec_t ts = { 0 };
+		api->get_object(L, gv->data[0].v_pointer, ts,
+		    FLAG_NOT_NEW_OBJECT);
+		break;
+
+	    default:
+		api->push_gvalue(L, (GValue*) gv);
+	}
+    }
+
+    val = _callback_call(L, cbi, stack_top);
+
+    // GLib has initialized the return value to the return type of the
+    // signal; booleans and integers, the only types supported by
+    // _callback_return_value, are both stored in v_int.
+    if (return_value && cbi->return_type != G_TYPE_NONE)
+	return_value->data[0].v_int = val;
+}
+
 #ifdef LUAGNOME_amd64
 
 // Avoid a warning about _callback being defined, but not used.  When
@@ -242,6 +419,30 @@ void dummy() {
  #define _callback _callback_amd64
 #endif
 
+/**
+ * Determine how a signal argument of the given type is pushed, see
+ * _callback.  Only types that G_VALUE_COLLECT takes as one plain value
+ * are handled directly; ENUMs, boxed types etc. need a GValue.
+ */
+static int _arg_kind(GType type)
+{
+    switch (type) {
+	case G_TYPE_INT:	return ARG_INT;
+	case G_TYPE_UINT:	return ARG_UINT;
+	case G_TYPE_LONG:	return ARG_LONG;
+	case G_TYPE_ULONG:	return ARG_ULONG;
+	case G_TYPE_BOOLEAN:	return ARG_BOOLEAN;
+	case G_TYPE_FLOAT:	return ARG_FLOAT;
+	case G_TYPE_DOUBLE:	return ARG_DOUBLE;
+	case G_TYPE_STRING:	return ARG_STRING;
+    }
+
+    if (G_TYPE_FUNDAMENTAL(type) == G_TYPE_OBJECT)
+	return ARG_OBJECT;
+
+    return ARG_GVALUE;
+}
+
 /**
  * Free memory on signal handler disconnection.
  *
@@ -268,7 +469,7 @@ static void _free_callback_info(gpointer data, GClosure *closure)
     // Is this required? I guess so.  See
     // glib/gobject/gclosure.c:g_closure_unref() - closure->data is not
     // freed there.
-    g_slice_free(struct callback_info, cb_info);
+    g_slice_free1(CALLBACK_INFO_SIZE(cb_info->query.n_params), cb_info);
 }
 
 
@@ -311,15 +512,22 @@ static int _connect(lua_State *L, GConnectFlags connect_flags)
 	luaL_error(L, "Can't find signal %s::%s\n", api->get_object_name(w),
 	    signame);
 
-    cb_info = g_slice_new(struct callback_info);
-    cb_info->L = L;
-    g_signal_query(signal_id, &cb_info->query);
-
-    if (cb_info->query.signal_id != signal_id) {
-	g_slice_free(struct callback_info, cb_info);
+    GSignalQuery query;
+    g_signal_query(signal_id, &query);
+    if (query.signal_id != signal_id)
 	luaL_error(L, "invalid signal ID %d for signal %s::%s\n",
 	    signal_id, api->get_object_name(w), signame);
-    }
+
+    cb_info = (struct callback_info*) g_slice_alloc(
+	CALLBACK_INFO_SIZE(query.n_params));
+    cb_info->L = L;
+    cb_info->query = query;
+    cb_info->return_type = query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE;
+    cb_info->flags = strcmp(query.signal_name, "query-tooltip") ? 0
+	: CB_QUERY_TOOLTIP;
+    for (i=0; i<query.n_params; i++)
+	cb_info->arg_kind[i] = _arg_kind(query.param_types[i]
+	    & ~G_SIGNAL_TYPE_STATIC_SCOPE);
 
     /* stack: object - signame - func - .... */
 
@@ -336,22 +544,32 @@ static int _connect(lua_State *L, GConnectFlags connect_flags)
     lua_pushvalue(L, 1);
     cb_info->object_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
-    // if there are more arguments, put them into a table, and store a
+    // if there are more arguments, put them into an array, and store a
     // reference to it.  When called just with NIL as "more arguments", ignore
     // that.
     if (stack_top > 3 && (stack_top != 4 || lua_type(L, 4) != LUA_TNIL)) {
-	lua_newtable(L);
+	lua_createtable(L, stack_top - 3, 0);
 	for (i=4; i<=stack_top; i++) {
 	    lua_pushvalue(L, i);
 	    lua_rawseti(L, -2, i - 3);	// [1] etc. are the parameters
 	}
 	cb_info->args_ref = luaL_ref(L, LUA_REGISTRYINDEX);
-    } else
+	cb_info->args_count = stack_top - 3;
+    } else {
 	cb_info->args_ref = 0;
+	cb_info->args_count = 0;
+    }
 
-    handler_id = g_signal_connect_data(w->p, signame,
-	(GCallback) _callback, cb_info, _free_callback_info,
-	G_CONNECT_SWAPPED | connect_flags);
+    if (dispatch_mode == DISPATCH_CLOSURE) {
+	GClosure *closure = g_closure_new_simple(sizeof(GClosure), cb_info);
+	g_closure_set_marshal(closure, _closure_marshal);
+	g_closure_add_finalize_notifier(closure, cb_info, _free_callback_info);
+	handler_id = g_signal_connect_closure(w->p, signame, closure,
+	    (connect_flags & G_CONNECT_AFTER) != 0);
+    } else
+	handler_id = g_signal_connect_data(w->p, signame,
+	    (GCallback) _callback, cb_info, _free_callback_info,
+	    G_CONNECT_SWAPPED | connect_flags);
 
     lua_pushnumber(L, handler_id);
 
@@ -391,3 +609,24 @@ int glib_disconnect(lua_State *L)
 }
 
 
+/**
+ * Select how signal handlers connected from now on are called.  With
+ * "closure", the default, GLib passes the arguments as GValues to a closure
+ * marshaller.  With "varargs", the handler is a C function with variable
+ * arguments, which have to be collected according to the signal's
+ * parameter types; this is the older method, kept for comparison.
+ *
+ * @name signal_set_dispatch
+ * @luaparam mode  "closure" or "varargs"
+ * @luareturn  The previous mode.
+ */
+int glib_signal_set_dispatch(lua_State *L)
+{
+    static const char *const modes[] = { "closure", "varargs", NULL };
+    int old = dispatch_mode;
+
+    dispatch_mode = luaL_checkoption(L, 1, NULL, modes);
+    lua_pushstring(L, modes[old]);
+    return 1;
+}
+
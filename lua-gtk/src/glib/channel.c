@@ -21,9 +21,10 @@
  * When g_io_add_watch is called, a Lua stack has to be provided.  This must
  * be the global, or initial, Lua stack and not of some coroutine.  Because
  * new watches may be created from within coroutines, the initial Lua stack
- * has to be stored somewhere...
+ * has to be stored somewhere...  This is the registry, as there may be
+ * multiple Lua states.  The key is the address of this variable.
  */
-static lua_State *global_lua_state;
+static const char _main_state_key = 0;
 
 
 /**
@@ -262,7 +263,10 @@ static int l_g_io_add_watch(lua_State *L)
 
     struct _watch_info *wi = g_slice_new(struct _watch_info);
 
-    wi->L = global_lua_state;
+    lua_pushlightuserdata(L, (void*) &_main_state_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    wi->L = (lua_State*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
     wi->gio = channel;
 
     // If the data is not in the global thread, move the arguments there.
@@ -443,7 +447,10 @@ static int _channel_handler(struct object *w, object_op op, int data)
 
 void glib_init_channel(lua_State *L)
 {
-    global_lua_state = L;
+    lua_pushlightuserdata(L, (void*) &_main_state_key);
+    lua_pushlightuserdata(L, L);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
     luaL_register(L, NULL, _channel_reg);
     api->register_object_type("channel", _channel_handler);
 }
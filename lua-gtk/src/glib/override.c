@@ -14,6 +14,7 @@ extern struct module_info modinfo_glib;
 int glib_connect(lua_State *L);
 int glib_connect_after(lua_State *L);
 int glib_disconnect(lua_State *L);
+int glib_signal_set_dispatch(lua_State *L);
 
 /**
  * Overrides for existing Gtk/Gdk functions.
@@ -442,6 +443,7 @@ const luaL_reg glib_overrides[] = {
     {"g_object_connect", glib_connect },
     {"g_object_connect_after", glib_connect_after },
     {"g_object_disconnect", glib_disconnect },
+    {"g_signal_set_dispatch", glib_signal_set_dispatch },
 
     { NULL, NULL }
 };
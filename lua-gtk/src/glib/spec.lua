@@ -281,6 +281,10 @@ linklist = {
     "g_type_parent",
     "g_value_unset",
     "g_assertion_message",
+    "g_closure_add_finalize_notifier",
+    "g_closure_new_simple",
+    "g_closure_set_marshal",
+    "g_signal_connect_closure",
     "g_signal_connect_data",
     "g_signal_handler_disconnect",
     "g_signal_lookup",
@@ -0,0 +1,538 @@
+/* vim:sw=4:sts=4
+ * Lua binding for the Gtk 2 toolkit.
+ * Typed array views: arrays of numbers, either allocated here or in the
+ * memory of an array object (see gnome.new_array), whose elements can be
+ * accessed without creating proxy objects, and which can be copied from and
+ * to Lua tables and strings in bulk.  They can be passed to library
+ * functions expecting a pointer to such numbers, e.g. gint* or gdouble*.
+ *
+ * Exported symbols:
+ *   lg_array_view_ptr
+ *   lg_init_array
+ *
+ * New functions:
+ *   gnome.array
+ */
+
+#include "luagnome.h"
+#include <string.h>	    // memcpy, strcmp
+
+#define ARRAY_META "gnome array"
+
+/* offset of the elements in the userdata of an array allocated here */
+#define ARRAY_OFFSET ((sizeof(struct array_view) + 7) & ~7)
+
+enum elem_kind { KIND_SIGNED, KIND_UNSIGNED, KIND_FLOAT };
+
+struct elem_type {
+    const char *name;
+    unsigned char size;
+    unsigned char kind;
+};
+
+static const struct elem_type elem_types[] = {
+    { "gint8",	    1,			KIND_SIGNED },
+    { "guint8",	    1,			KIND_UNSIGNED },
+    { "gchar",	    1,			KIND_SIGNED },
+    { "guchar",	    1,			KIND_UNSIGNED },
+    { "gint16",	    2,			KIND_SIGNED },
+    { "guint16",    2,			KIND_UNSIGNED },
+    { "gshort",	    sizeof(short),	KIND_SIGNED },
+    { "gushort",    sizeof(short),	KIND_UNSIGNED },
+    { "gint32",	    4,			KIND_SIGNED },
+    { "guint32",    4,			KIND_UNSIGNED },
+    { "gint",	    sizeof(int),	KIND_SIGNED },
+    { "guint",	    sizeof(int),	KIND_UNSIGNED },
+    { "gboolean",   sizeof(gboolean),	KIND_SIGNED },
+    { "gint64",	    8,			KIND_SIGNED },
+    { "guint64",    8,			KIND_UNSIGNED },
+    { "glong",	    sizeof(long),	KIND_SIGNED },
+    { "gulong",	    sizeof(long),	KIND_UNSIGNED },
+    { "gfloat",	    sizeof(float),	KIND_FLOAT },
+    { "gdouble",    sizeof(double),	KIND_FLOAT },
+    { NULL, 0, 0 }
+};
+
+struct array_view {
+    unsigned char *p;		/* first element, unless owner is set */
+    struct object *owner;	/* object whose memory is used, or NULL */
+    int count;			/* number of elements */
+    const struct elem_type *et;
+};
+
+
+static const struct elem_type *_find_elem_type(lua_State *L, int index)
+{
+    const char *name = luaL_checkstring(L, index);
+    const struct elem_type *et;
+
+    for (et=elem_types; et->name; et++)
+	if (!strcmp(et->name, name))
+	    return et;
+
+    luaL_argerror(L, index, "unknown element type");
+    return NULL;
+}
+
+
+/**
+ * Get the address of the first element.  The memory of an array object may
+ * have been freed in the meantime.
+ */
+static inline unsigned char *_view_data(lua_State *L, struct array_view *v)
+{
+    if (!v->owner)
+	return v->p;
+    if (G_UNLIKELY(!v->owner->p))
+	luaL_error(L, "%s array view of a freed object", msgprefix);
+    return (unsigned char*) v->owner->p;
+}
+
+
+static inline struct array_view *_check_view(lua_State *L, int index)
+{
+    return (struct array_view*) luaL_checkudata(L, index, ARRAY_META);
+}
+
+
+/**
+ * Convert a 1 based index to the address of the element.
+ */
+static unsigned char *_elem_ptr(lua_State *L, struct array_view *v, int index)
+{
+    int i = luaL_checkint(L, index);
+
+    if (G_UNLIKELY(i < 1 || i > v->count))
+	luaL_error(L, "%s index %d is out of bounds", msgprefix, i);
+    return _view_data(L, v) + (i - 1) * v->et->size;
+}
+
+
+static lua_Number _get_elem(const struct elem_type *et, const unsigned char *p)
+{
+    switch (et->kind) {
+	case KIND_SIGNED:
+	    switch (et->size) {
+		case 1: return * (const gint8*) p;
+		case 2: return * (const gint16*) p;
+		case 4: return * (const gint32*) p;
+		case 8: return * (const gint64*) p;
+	    }
+	    break;
+
+	case KIND_UNSIGNED:
+	    switch (et->size) {
+		case 1: return * (const guint8*) p;
+		case 2: return * (const guint16*) p;
+		case 4: return * (const guint32*) p;
+		case 8: return * (const guint64*) p;
+	    }
+	    break;
+
+	case KIND_FLOAT:
+	    if (et->size == sizeof(float))
+		return * (const float*) p;
+	    return * (const double*) p;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Convert a number to the bits of a 64 bit integer, which are then truncated
+ * to the element size.  Converting a lua_Number that doesn't fit the target
+ * type is undefined, so this goes through a 64 bit type that can hold it;
+ * numbers outside of that range, and NaN, give 0.
+ */
+static inline guint64 _number_to_bits(lua_Number v)
+{
+    if (v >= 0)
+	return v < 18446744073709551616.0 ? (guint64) v : 0;
+    return v >= -9223372036854775808.0 ? (guint64) (gint64) v : 0;
+}
+
+static void _set_elem(const struct elem_type *et, unsigned char *p,
+    lua_Number v)
+{
+    guint64 bits;
+
+    switch (et->kind) {
+	case KIND_SIGNED:
+	    bits = _number_to_bits(v);
+	    switch (et->size) {
+		case 1: * (gint8*) p = (gint8) bits; return;
+		case 2: * (gint16*) p = (gint16) bits; return;
+		case 4: * (gint32*) p = (gint32) bits; return;
+		case 8: * (gint64*) p = (gint64) bits; return;
+	    }
+	    break;
+
+	case KIND_UNSIGNED:
+	    bits = _number_to_bits(v);
+	    switch (et->size) {
+		case 1: * (guint8*) p = (guint8) bits; return;
+		case 2: * (guint16*) p = (guint16) bits; return;
+		case 4: * (guint32*) p = (guint32) bits; return;
+		case 8: * (guint64*) p = bits; return;
+	    }
+	    break;
+
+	case KIND_FLOAT:
+	    if (et->size == sizeof(float))
+		* (float*) p = (float) v;
+	    else
+		* (double*) p = (double) v;
+	    return;
+    }
+}
+
+
+/**
+ * Check the optional range arguments i and j, which default to the whole
+ * array.
+ *
+ * @return  The number of elements in the range; *first is 0 based.
+ */
+static int _get_range(lua_State *L, struct array_view *v, int index,
+    int *first)
+{
+    int i = luaL_optint(L, index, 1), j = luaL_optint(L, index + 1, v->count);
+
+    if (i < 1 || j > v->count || i > j + 1)
+	luaL_error(L, "%s invalid range %d to %d of array with %d elements",
+	    msgprefix, i, j, v->count);
+    *first = i - 1;
+    return j - i + 1;
+}
+
+
+/**
+ * Element access by number, or methods by name.
+ */
+static int l_array_index(lua_State *L)
+{
+    struct array_view *v = (struct array_view*) lua_touserdata(L, 1);
+
+    if (G_LIKELY(lua_type(L, 2) == LUA_TNUMBER)) {
+	lua_pushnumber(L, _get_elem(v->et, _elem_ptr(L, v, 2)));
+	return 1;
+    }
+
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+
+static int l_array_newindex(lua_State *L)
+{
+    struct array_view *v = (struct array_view*) lua_touserdata(L, 1);
+    _set_elem(v->et, _elem_ptr(L, v, 2), luaL_checknumber(L, 3));
+    return 0;
+}
+
+
+static int l_array_len(lua_State *L)
+{
+    struct array_view *v = (struct array_view*) lua_touserdata(L, 1);
+    lua_pushinteger(L, v->count);
+    return 1;
+}
+
+
+static int l_array_tostring(lua_State *L)
+{
+    struct array_view *v = (struct array_view*) lua_touserdata(L, 1);
+    lua_pushfstring(L, "%s[%d] at %p", v->et->name, v->count,
+	v->owner ? v->owner->p : (void*) v->p);
+    return 1;
+}
+
+
+/**
+ * Copy a range of elements into a new table.
+ *
+ * @name slice
+ * @luaparam i  (optional) first element, default 1
+ * @luaparam j  (optional) last element, default the last one
+ * @luareturn  A table with the elements
+ */
+static int l_array_slice(lua_State *L)
+{
+    struct array_view *v = _check_view(L, 1);
+    int first, n = _get_range(L, v, 2, &first), i;
+    const unsigned char *p = _view_data(L, v) + first * v->et->size;
+
+    lua_createtable(L, n, 0);
+    for (i=1; i<=n; i++, p += v->et->size) {
+	lua_pushnumber(L, _get_elem(v->et, p));
+	lua_rawseti(L, -2, i);
+    }
+    return 1;
+}
+
+
+/**
+ * Set a range of elements to the same value.
+ *
+ * @name fill
+ * @luaparam value  The value to store
+ * @luaparam i  (optional) first element, default 1
+ * @luaparam j  (optional) last element, default the last one
+ */
+static int l_array_fill(lua_State *L)
+{
+    struct array_view *v = _check_view(L, 1);
+    lua_Number value = luaL_checknumber(L, 2);
+    int first, n = _get_range(L, v, 3, &first), size = v->et->size, done;
+    unsigned char *p = _view_data(L, v) + first * size;
+
+    if (n <= 0)
+	return 0;
+
+    // set the first element, then copy blocks of doubling size.
+    _set_elem(v->et, p, value);
+    n *= size;
+    for (done=size; done < n; done *= 2)
+	memcpy(p + done, p, MIN(done, n - done));
+    return 0;
+}
+
+
+/**
+ * Copy the numbers in a table into the array.
+ *
+ * @name from_table
+ * @luaparam t  Table with the numbers at the indices 1 to #t
+ * @luaparam i  (optional) index of the element to store t[1] in, default 1
+ * @luareturn  The number of elements copied
+ */
+static int l_array_from_table(lua_State *L)
+{
+    struct array_view *v = _check_view(L, 1);
+    int n, i, first = luaL_optint(L, 3, 1) - 1, size = v->et->size;
+    unsigned char *p;
+
+    luaL_checktype(L, 2, LUA_TTABLE);
+    n = lua_objlen(L, 2);
+    if (first < 0 || first + n > v->count)
+	luaL_error(L, "%s %d elements don't fit into array with %d elements "
+	    "at %d", msgprefix, n, v->count, first + 1);
+
+    p = _view_data(L, v) + first * size;
+    for (i=1; i<=n; i++, p += size) {
+	lua_rawgeti(L, 2, i);
+	_set_elem(v->et, p, lua_tonumber(L, -1));
+	lua_pop(L, 1);
+    }
+
+    lua_pushinteger(L, n);
+    return 1;
+}
+
+
+/**
+ * Copy the memory of a range of elements into a string.
+ *
+ * @name to_string
+ * @luaparam i  (optional) first element, default 1
+ * @luaparam j  (optional) last element, default the last one
+ * @luareturn  A string with the elements in the machine's byte order
+ */
+static int l_array_to_string(lua_State *L)
+{
+    struct array_view *v = _check_view(L, 1);
+    int first, n = _get_range(L, v, 2, &first);
+
+    lua_pushlstring(L, (const char*) _view_data(L, v) + first * v->et->size,
+	n * v->et->size);
+    return 1;
+}
+
+
+/**
+ * Copy the contents of a string, as returned by to_string, into the array.
+ *
+ * @name from_string
+ * @luaparam s  The string; its length must be a multiple of the element size
+ * @luaparam i  (optional) index of the first element to overwrite, default 1
+ * @luareturn  The number of elements copied
+ */
+static int l_array_from_string(lua_State *L)
+{
+    struct array_view *v = _check_view(L, 1);
+    size_t len;
+    const char *s = luaL_checklstring(L, 2, &len);
+    int first = luaL_optint(L, 3, 1) - 1, n = len / v->et->size;
+
+    if (len % v->et->size)
+	luaL_argerror(L, 2, "length is not a multiple of the element size");
+    if (first < 0 || first + n > v->count)
+	luaL_error(L, "%s %d elements don't fit into array with %d elements "
+	    "at %d", msgprefix, n, v->count, first + 1);
+
+    memcpy(_view_data(L, v) + first * v->et->size, s, len);
+    lua_pushinteger(L, n);
+    return 1;
+}
+
+
+static const luaL_reg array_methods[] = {
+    { "slice",		l_array_slice },
+    { "fill",		l_array_fill },
+    { "from_table",	l_array_from_table },
+    { "to_string",	l_array_to_string },
+    { "from_string",	l_array_from_string },
+    { NULL, NULL }
+};
+
+
+/**
+ * Push the metatable for array views, creating it on first use.  Its
+ * __index has the table of methods as upvalue.
+ */
+static void _push_array_meta(lua_State *L)
+{
+    if (!luaL_newmetatable(L, ARRAY_META))
+	return;
+
+    lua_newtable(L);				// mt methods
+    luaL_register(L, NULL, array_methods);
+    lua_pushcclosure(L, l_array_index, 1);	// mt __index
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, l_array_newindex);
+    lua_setfield(L, -2, "__newindex");
+    lua_pushcfunction(L, l_array_len);
+    lua_setfield(L, -2, "__len");
+    lua_pushcfunction(L, l_array_tostring);
+    lua_setfield(L, -2, "__tostring");
+}
+
+
+/**
+ * Create a typed array view.  Either a new array is allocated, initialized
+ * with zero or with the numbers in a table, or the memory of an existing
+ * object is used, usually an array of structures allocated by new_array;
+ * the view keeps this object alive.
+ *
+ * @name array
+ * @luaparam type  Type of the elements, e.g. "gint" or "gdouble"
+ * @luaparam n  Number of elements, or a table with their initial values
+ * @luaoverload
+ * @luaparam object  An object whose memory to use
+ * @luaparam type  Type of the elements
+ * @luaparam n  (optional) Number of elements; the default is to cover the
+ *   whole object, including all elements of an array.
+ * @luareturn  The array view
+ */
+static int l_array(lua_State *L)
+{
+    const struct elem_type *et;
+    struct array_view *v;
+    struct object *o;
+    int count, size;
+
+    // view of an existing object
+    if (lua_type(L, 1) == LUA_TUSERDATA) {
+	o = lg_check_object(L, 1);
+	if (!o || !o->p)
+	    luaL_argerror(L, 1, "object expected");
+	et = _find_elem_type(L, 2);
+	type_info_t ti = lg_get_type_info(o->ts);
+	size = ti->st.struct_size * (o->array_size ? o->array_size : 1);
+	count = luaL_optint(L, 3, size / et->size);
+	if (count < 0 || count * et->size > size)
+	    luaL_error(L, "%s %d elements of %s don't fit into %s",
+		msgprefix, count, et->name, lg_get_object_name(o));
+
+	v = (struct array_view*) lua_newuserdata(L, sizeof(*v));
+	v->p = NULL;
+	v->owner = o;
+	v->count = count;
+	v->et = et;
+
+	// the environment keeps the object alive
+	lua_createtable(L, 1, 0);
+	lua_pushvalue(L, 1);
+	lua_rawseti(L, -2, 1);
+	lua_setfenv(L, -2);
+	_push_array_meta(L);
+	lua_setmetatable(L, -2);
+	return 1;
+    }
+
+    et = _find_elem_type(L, 1);
+    if (lua_type(L, 2) == LUA_TTABLE)
+	count = lua_objlen(L, 2);
+    else
+	count = luaL_checkint(L, 2);
+    if (count < 0)
+	return luaL_error(L, "%s invalid array size %d", msgprefix, count);
+
+    size = ARRAY_OFFSET + count * et->size;
+    v = (struct array_view*) lua_newuserdata(L, size);
+    memset(v, 0, size);
+    v->p = ((unsigned char*) v) + ARRAY_OFFSET;
+    v->count = count;
+    v->et = et;
+    _push_array_meta(L);
+    lua_setmetatable(L, -2);
+
+    if (lua_type(L, 2) == LUA_TTABLE) {
+	int i;
+	unsigned char *p = v->p;
+	for (i=1; i<=count; i++, p += et->size) {
+	    lua_rawgeti(L, 2, i);
+	    _set_elem(et, p, lua_tonumber(L, -1));
+	    lua_pop(L, 1);
+	}
+    }
+
+    return 1;
+}
+
+
+/**
+ * If the value at the given index is an array view, return the address of
+ * its elements, so that it can be passed to a library function.
+ *
+ * @param L  Lua State
+ * @param index  Stack position of the value
+ * @param size  Size of the elements the function expects
+ * @param is_float  True if the function expects floating point numbers
+ * @return  The address, or NULL if the value is not an array view.  Raises
+ *   an error if the elements have a different type.
+ */
+void *lg_array_view_ptr(lua_State *L, int index, int size, int is_float)
+{
+    struct array_view *v;
+
+    if (lua_type(L, index) != LUA_TUSERDATA || !lua_getmetatable(L, index))
+	return NULL;
+    luaL_getmetatable(L, ARRAY_META);
+    if (!lua_rawequal(L, -1, -2)) {
+	lua_pop(L, 2);
+	return NULL;
+    }
+    lua_pop(L, 2);
+
+    v = (struct array_view*) lua_touserdata(L, index);
+    if (v->et->size != size || (v->et->kind == KIND_FLOAT) != !!is_float)
+	luaL_error(L, "%s array of %s can't be used for this argument",
+	    msgprefix, v->et->name);
+    return _view_data(L, v);
+}
+
+
+static const luaL_reg gnome_methods[] = {
+    { "array",		l_array },
+    { NULL, NULL }
+};
+
+/* Register the array functions in the gnome table */
+void lg_init_array(lua_State *L)
+{
+    luaL_register(L, NULL, gnome_methods);
+}
+
@@ -335,8 +335,14 @@ static const luaL_reg gnome_methods[] = {
  */
 void lg_init_boxed(lua_State *L)
 {
-    lg_boxed_value_type = g_boxed_type_register_static("LuaValue",
-	_boxed_copy, lg_boxed_free);
+    static volatile int lock = 0;
+
+    // only once per process, even with multiple Lua states.
+    LG_LOCK(lock);
+    if (!lg_boxed_value_type)
+	lg_boxed_value_type = g_boxed_type_register_static("LuaValue",
+	    _boxed_copy, lg_boxed_free);
+    LG_UNLOCK(lock);
 
     luaL_register(L, NULL, gnome_methods);
 
@@ -7,6 +7,8 @@
  * Exported functions:
  *   lg_call
  *   lg_call_byname
+ *   lg_call_batch
+ *   lg_call_arena_stats
  *   get_next_argument
  *   call_info_alloc_item
  *   call_info_msg
@@ -26,19 +28,105 @@
 #include "lg_ffi.h"	    // LUAGNOME_FFI_TYPE() macro
 
 
-/* extra arguments that have to be allocated are kept in this list. */
-struct call_info_list {
-    struct call_info_list *next;
-    /* payload starts here */
+/*-
+ * Extra arguments that have to be allocated are taken from an arena, i.e.
+ * one block of memory that is reused for each call; see call_info_alloc_item.
+ * When a block is full, a larger one is allocated; the old ones are kept
+ * until the end of the call.
+ */
+struct call_arena {
+    struct call_arena *prev;		/* older, smaller blocks */
+    int size;				/* usable bytes in data */
+    union gtk_arg_types data[0];	/* properly aligned */
 };
 
-/* already allocated, but discarded structures */
-/* XXX for multithreading, this would have to be protected by a spinlock */
-static struct call_info *ci_pool = NULL;
+/* size of the first block of an arena */
+#define CALL_ARENA_MIN 256
+
+/* counters for gnome.get_arena_stats, per thread */
+static LG_THREAD_LOCAL struct {
+    unsigned long items;		/* calls to call_info_alloc_item */
+    unsigned long bytes;		/* bytes handed out */
+    unsigned long blocks;		/* g_malloc calls for blocks */
+} arena_stats;
+
+/* already allocated, but discarded structures; each thread has its own
+ * pool, so no locking is required. */
+static LG_THREAD_LOCAL struct call_info *ci_pool = NULL;
+
+/* the currently running function of this thread; required by
+ * init.c:lg_log_func. */
+LG_THREAD_LOCAL struct call_info *ci_current = NULL;
+
+/*-
+ * A function to call a library function directly, i.e. by casting it to the
+ * proper prototype, instead of using ffi_call.  It is given the arguments
+ * as converted by _call_build_parameters and has to store the return value
+ * in ci->args[0] like ffi_call would.
+ */
+typedef void (*call_stub_t)(void *func, struct call_info *ci);
+
+/*-
+ * Decoded description of one argument of a library function, see struct
+ * call_plan.
+ */
+struct call_plan_arg {
+    typespec_t ts;			/* resolved (native) type */
+    typespec_t out_ts;			/* type with one indirection less */
+    const struct ffi_type_map_t *arg_type;
+    unsigned int arg_flags : 8,		/* see get_next_argument */
+	is_vararg : 1;
+};
+
+/*-
+ * The argument spec (args_info) of a library function decoded into an array,
+ * so that the two passes over the arguments in lg_call don't have to parse
+ * it and resolve the types each time.  It also contains the prepared libffi
+ * call interface; the argument types of a function are always the same,
+ * except for functions with a vararg, where they depend on the actual
+ * arguments.
+ *
+ * Plans are never freed (except by call_info_free_pool), and are shared by all
+ * functions with the same argument spec.
+ */
+struct call_plan {
+    ffi_cif cif;
+    int arg_count;		/* including the return value */
+    unsigned int is_vararg : 1,	/* has a vararg; cif is not used */
+	cif_ok : 1,		/* cif has been prepared */
+	has_output : 1,		/* has output or INCREF arguments */
+	returns_void : 1;	/* no return value, no arg_flags on it */
+    ffi_type **argtypes;	/* [arg_count], [0] is the return type */
+    call_stub_t stub;		/* direct call without libffi, or NULL */
+    struct call_plan_arg args[0];   /* [arg_count] */
+};
+
+/* struct call_plan entries keyed by the args_info of the function; shared
+ * by all threads and protected by plan_lock. */
+static GHashTable *plan_cache = NULL;
+static volatile int plan_lock = 0;
+
+/**
+ * Clear a call_info structure that has been used before, so it can be used
+ * for another call.  Can't just clear the whole structure, because arg_alloc
+ * and args need to be kept.
+ */
+static void _call_info_reset(struct call_info *ci)
+{
+    // Zero out the arguments, if any, that were used by the last call.
+    if (ci->args) {
+	int n = ci->arg_count;
+	memset(ci->args, 0, sizeof(*ci->args) * n);
+	memset(ci->argtypes, 0, sizeof(*ci->argtypes) * n);
+	memset(ci->argvalues, 0, sizeof(*ci->argvalues) * n);
+    }
+    ci->L = NULL;
+    ci->index = 0;
+    ci->fi = NULL;
+    ci->arg_count = 0;
+    ci->warnings = 0;
+}
 
-/* the currently running function; XXX not suitable for multithreading */
-/* required by init.c:lg_log_func. */
-struct call_info *ci_current = NULL;
 
 /**
  * Provide an unused call_info structure.  It may be taken from the pool, or
@@ -48,29 +136,11 @@ struct call_info *call_info_alloc()
 {
     struct call_info *ci;
 
-    // lock_spinlock
     if (ci_pool) {
 	ci = ci_pool;
 	ci_pool = ci->next;
-	// unlock_spinlock
-	
-	// Zero out the arguments, if any, that were used by the last call.
-	// Can't just clear the whole structure, because arg_alloc and args
-	// need to be kept.
-	if (ci->args) {
-	    int n = ci->arg_count;
-	    memset(ci->args, 0, sizeof(*ci->args) * n);
-	    memset(ci->argtypes, 0, sizeof(*ci->argtypes) * n);
-	    memset(ci->argvalues, 0, sizeof(*ci->argvalues) * n);
-	}
-	ci->L = NULL;
-	ci->index = 0;
-	ci->fi = NULL;
-	ci->arg_count = 0;
-	ci->warnings = 0;
-	ci->first = NULL;
+	_call_info_reset(ci);
     } else {
-	// unlock_spinlock
 	ci = g_slice_new0(struct call_info);
     }
 
@@ -79,21 +149,59 @@ struct call_info *call_info_alloc()
 
 
 /**
- * Allocate space for an extra parameter.  These memory blocks are kept in
- * a singly linked list and are freed in call_info_free.
+ * Allocate space for an extra parameter.  The memory is taken from the
+ * arena of the call_info and is valid until call_info_free is called.
+ * Usually no malloc is required, as the arena is kept with the call_info
+ * in the pool.
  *
  * @param ci  The call_info this memory is allocated for
  * @param size  How many bytes to allocate
- * @return  A pointer to the newly allocated memory.
+ * @return  A pointer to the newly allocated memory, which is zeroed.
  */
 void *call_info_alloc_item(struct call_info *ci, int size)
 {
-    size += sizeof(struct call_info_list);
-    struct call_info_list *item = (struct call_info_list*) g_malloc(size);
-    memset(item, 0, size);
-    item->next = ci->first;
-    ci->first = item;
-    return item + 1;
+    struct call_arena *a = ci->arena;
+    char *p;
+
+    size = (size + sizeof(*a->data) - 1) & ~(sizeof(*a->data) - 1);
+
+    if (G_UNLIKELY(!a || ci->arena_used + size > a->size)) {
+	int n = a ? a->size * 2 : CALL_ARENA_MIN;
+	while (n < size)
+	    n *= 2;
+	a = (struct call_arena*) g_malloc(sizeof(*a) + n);
+	a->prev = ci->arena;
+	a->size = n;
+	ci->arena = a;
+	ci->arena_used = 0;
+	arena_stats.blocks ++;
+    }
+
+    p = (char*) a->data + ci->arena_used;
+    ci->arena_used += size;
+    memset(p, 0, size);
+
+    arena_stats.items ++;
+    arena_stats.bytes += size;
+    return p;
+}
+
+/**
+ * Make the arena empty again.  When it had to grow during the call, free the
+ * older blocks, so that only the largest remains.
+ */
+static void _call_arena_reset(struct call_info *ci)
+{
+    struct call_arena *a, *prev;
+
+    if (G_UNLIKELY(ci->arena && ci->arena->prev)) {
+	for (a=ci->arena->prev; a; a=prev) {
+	    prev = a->prev;
+	    g_free(a);
+	}
+	ci->arena->prev = NULL;
+    }
+    ci->arena_used = 0;
 }
 
 static void call_info_free_arg(struct call_info *ci, int idx)
@@ -121,44 +229,52 @@ static void call_info_free_arg(struct call_info *ci, int idx)
 
 
 /**
- * Release a call_info structure.  The attached extra parameters are freed,
- * then the stucture is put into the pool.
+ * Free the extra parameters attached to a call_info structure after a call.
  *
  * If a warning has been displayed, output a newline.  Note that ci->warnings
  * may be set to 2, this means that an unconditional trace caused the function
  * call to be printed; in this case, no extra newline is desired.
- *
- * @param ci   The structure to be freed
  */
-void call_info_free(struct call_info *ci)
+static void _call_info_release(struct call_info *ci)
 {
-    struct call_info_list *p, *next;
     int i;
 
-    // free all extra memory allocated for arguments
-    for (p=ci->first; p; p=next) {
-	next = p->next;
-	g_free(p);
-    }
+    // automatic closures bound to this call are stale from now on
+    ci->serial ++;
 
-    // possibly free more arguments
+    // possibly free more arguments.  Do this first, as they may be stored
+    // in the arena.
     for (i=0; i<ci->arg_count; i++)
 	if (ci->args[i].free_method)
 	    call_info_free_arg(ci, i);
 
+    // all extra memory allocated for arguments is free again
+    _call_arena_reset(ci);
+
     if (ci->warnings == 1)
 	printf("\n");
+}
+
+
+/**
+ * Release a call_info structure.  The attached extra parameters are freed,
+ * then the stucture is put into the pool.
+ *
+ * @param ci   The structure to be freed
+ */
+void call_info_free(struct call_info *ci)
+{
+    _call_info_release(ci);
 
-    // lock spinlock
     ci->next = ci_pool;
     ci_pool = ci;
-    // unlock spinlock
 }
 
 
 /**
  * At program exit (library close), free the pool.  This is not really required
- * but may help spotting memory leaks.
+ * but may help spotting memory leaks.  Note that this only frees the pool of
+ * the calling thread, i.e. the main thread when run by atexit.
  */
 void call_info_free_pool()
 {
@@ -174,8 +290,26 @@ void call_info_free_pool()
 	    p->argtypes = NULL;
 	    p->argvalues = NULL;
 	}
+	if (p->arena) {
+	    _call_arena_reset(p);
+	    g_free(p->arena);
+	    p->arena = NULL;
+	}
 	g_slice_free(struct call_info, p);
     }
+
+    LG_LOCK(plan_lock);
+    if (plan_cache) {
+	GHashTableIter iter;
+	gpointer plan;
+
+	g_hash_table_iter_init(&iter, plan_cache);
+	while (g_hash_table_iter_next(&iter, NULL, &plan))
+	    g_free(plan);
+	g_hash_table_destroy(plan_cache);
+	plan_cache = NULL;
+    }
+    LG_UNLOCK(plan_lock);
 }
 
 
@@ -292,6 +426,225 @@ inline void get_next_argument(lua_State *L, const unsigned char **p,
 }
 
 
+/*-
+ * Direct call stubs for the most common signatures of library functions.
+ * They are named after the return type and the argument types.  Integer
+ * arguments are stored as long by lua2ffi_long and lua2ffi_enum, and integer
+ * return values are widened to long, just like libffi does.
+ */
+static void _stub_void_ptr(void *func, struct call_info *ci)
+{
+    ((void (*)(void*)) func)(ci->args[1].ffi_arg.p);
+}
+
+static void _stub_sint_ptr(void *func, struct call_info *ci)
+{
+    ci->args[0].ffi_arg.l = (long) ((int (*)(void*)) func)(
+	ci->args[1].ffi_arg.p);
+}
+
+static void _stub_uint_ptr(void *func, struct call_info *ci)
+{
+    ci->args[0].ffi_arg.l = (long) ((unsigned int (*)(void*)) func)(
+	ci->args[1].ffi_arg.p);
+}
+
+static void _stub_ptr_ptr(void *func, struct call_info *ci)
+{
+    ci->args[0].ffi_arg.p = ((void* (*)(void*)) func)(ci->args[1].ffi_arg.p);
+}
+
+static void _stub_void_ptr_int(void *func, struct call_info *ci)
+{
+    ((void (*)(void*, int)) func)(ci->args[1].ffi_arg.p,
+	(int) ci->args[2].ffi_arg.l);
+}
+
+static void _stub_void_ptr_ptr(void *func, struct call_info *ci)
+{
+    ((void (*)(void*, void*)) func)(ci->args[1].ffi_arg.p,
+	ci->args[2].ffi_arg.p);
+}
+
+#define IS_INT_TYPE(t) ((t) == &ffi_type_sint || (t) == &ffi_type_uint)
+
+/**
+ * Find a direct call stub for the signature of the plan.  Only a few, but
+ * very common signatures are handled; everything else goes through libffi.
+ *
+ * @return  The stub, or NULL if none is available.
+ */
+static call_stub_t _call_select_stub(const struct call_plan *plan)
+{
+    ffi_type **t = plan->argtypes;
+
+    if (plan->is_vararg || plan->arg_count < 2 || t[1] != &ffi_type_pointer)
+	return NULL;
+
+    if (plan->arg_count == 2) {
+	if (t[0] == &ffi_type_void)
+	    return _stub_void_ptr;
+	if (t[0] == &ffi_type_sint)
+	    return _stub_sint_ptr;
+	if (t[0] == &ffi_type_uint)
+	    return _stub_uint_ptr;
+	if (t[0] == &ffi_type_pointer)
+	    return _stub_ptr_ptr;
+	return NULL;
+    }
+
+    if (plan->arg_count == 3 && t[0] == &ffi_type_void) {
+	if (IS_INT_TYPE(t[2]))
+	    return _stub_void_ptr_int;
+	if (t[2] == &ffi_type_pointer)
+	    return _stub_void_ptr_ptr;
+    }
+
+    return NULL;
+}
+
+#undef IS_INT_TYPE
+
+
+/**
+ * Count the arguments in a function's argument spec, including the return
+ * value.  See get_next_argument for the encoding.
+ */
+static int _call_count_args(const unsigned char *s, const unsigned char *s_end)
+{
+    int n = 0;
+
+    while (s < s_end) {
+	if (!*s)
+	    s += 2;
+	if (*s++ & 0x80)
+	    s++;
+	n++;
+    }
+
+    return n;
+}
+
+
+/**
+ * Decode the argument spec of a function into a struct call_plan.  This
+ * resolves all non-native types, which may require other modules to be
+ * loaded, and prepares the call interface for libffi unless the function
+ * takes a vararg.
+ *
+ * @param L  lua_State
+ * @param fi  The function to build the plan for
+ * @return  A newly allocated plan.
+ */
+static struct call_plan *_call_build_plan(lua_State *L,
+    const struct func_info *fi)
+{
+    const unsigned char *s = fi->args_info, *s_end = s + fi->args_len;
+    struct call_plan *plan;
+    struct call_plan_arg *pa;
+    struct argconv_t ar;
+    int i, n, idx, untyped = 0;
+
+    n = _call_count_args(s, s_end);
+    plan = (struct call_plan*) g_malloc0(sizeof(*plan)
+	+ n * (sizeof(*plan->args) + sizeof(*plan->argtypes)));
+    plan->arg_count = n;
+    plan->argtypes = (ffi_type**) (plan->args + n);
+
+    memset(&ar, 0, sizeof(ar));
+    for (i=0; i<n; i++) {
+	pa = &plan->args[i];
+	ar.ts.module_idx = fi->module_idx;
+	get_next_argument(L, &s, &ar);
+	pa->ts = ar.ts;
+	pa->arg_flags = ar.arg_flags;
+	pa->arg_type = lg_get_ffi_type(ar.ts);
+
+	idx = pa->arg_type->ffi_type_idx;
+	plan->argtypes[i] = idx ? LUAGNOME_FFI_TYPE(idx) : NULL;
+	if (!idx)
+	    untyped = 1;
+
+	if (!strcmp(FTYPE_NAME(pa->arg_type), "vararg")) {
+	    pa->is_vararg = 1;
+	    plan->is_vararg = 1;
+	}
+
+	if (i == 0)
+	    continue;
+
+	// The INCREF flag is handled in the return pass.
+	if (pa->arg_flags & FLAG_INCREF)
+	    plan->has_output = 1;
+
+	// only pointers with a conversion function can be output arguments;
+	// their output type has one level of indirection less.
+	idx = pa->arg_type->conv_idx;
+	if (pa->arg_type->indirections && idx && ffi_type_ffi2lua[idx]) {
+	    pa->out_ts = lg_type_modify(L, pa->ts, -1);
+	    plan->has_output = 1;
+	}
+    }
+
+    // a void function without output arguments needs no return pass, unless
+    // the module wants to see the arg_flags of the return value.
+    plan->returns_void = n > 0 && plan->argtypes[0] == &ffi_type_void
+	&& !(plan->args[0].arg_flags & 0xf0);
+
+    // with a missing ffi type, _call_build_parameters raises an error.
+    if (!plan->is_vararg && n > 0 && !untyped)
+	plan->cif_ok = ffi_prep_cif(&plan->cif, FFI_DEFAULT_ABI, n - 1,
+	    plan->argtypes[0], plan->argtypes + 1) == FFI_OK;
+
+    if (plan->cif_ok)
+	plan->stub = _call_select_stub(plan);
+
+    return plan;
+}
+
+
+/**
+ * Get the call plan for a function.  It is cached in the func_info, and
+ * additionally in a hash table keyed by the argument spec, so that it is
+ * found for other func_info structures describing the same function (e.g.
+ * temporary ones in lg_call_byname, or copies made by lg_push_closure), and
+ * shared among functions with the same prototype.
+ *
+ * The plan is built without holding the lock, as this may raise Lua errors.
+ * If another thread has added a plan for the same function meanwhile, that
+ * one is used and the new one discarded.
+ */
+static struct call_plan *_call_get_plan(lua_State *L, struct func_info *fi)
+{
+    struct call_plan *plan, *new_plan;
+
+    LG_LOCK(plan_lock);
+    if (G_UNLIKELY(!plan_cache))
+	plan_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+    plan = (struct call_plan*) g_hash_table_lookup(plan_cache,
+	fi->args_info);
+    LG_UNLOCK(plan_lock);
+
+    if (!plan) {
+	new_plan = _call_build_plan(L, fi);
+	LG_LOCK(plan_lock);
+	plan = (struct call_plan*) g_hash_table_lookup(plan_cache,
+	    fi->args_info);
+	if (!plan) {
+	    g_hash_table_insert(plan_cache, (gpointer) fi->args_info, new_plan);
+	    plan = new_plan;
+	    new_plan = NULL;
+	}
+	LG_UNLOCK(plan_lock);
+	if (new_plan)
+	    g_free(new_plan);
+    }
+
+    fi->plan = plan;
+    return plan;
+}
+
+
 /**
  * Prepare to call the Gtk function by converting all the parameters into
  * the required format as required by libffi.
@@ -299,15 +652,17 @@ inline void get_next_argument(lua_State *L, const unsigned char **p,
  * @param L        lua_State
  * @param index    Lua stack position of first parameter
  * @param ci       call_info structure with lots more data
+ * @param plan     The decoded argument spec of the function
  *
  * Returns 0 on error, 1 otherwise.
  */
-static int _call_build_parameters(lua_State *L, int index, struct call_info *ci)
+static int _call_build_parameters(lua_State *L, int index, struct call_info *ci,
+    const struct call_plan *plan)
 {
-    const unsigned char *s, *s_end;
+    const struct call_plan_arg *pa;
     struct argconv_t ar;
     struct call_arg *ca;
-    int arg_nr, idx;
+    int arg_nr, i, idx;
 
     /* build the call stack by parsing the parameter list */
     memset(&ar, 0, sizeof(ar));
@@ -315,8 +670,6 @@ static int _call_build_parameters(lua_State *L, int index, struct call_info *ci)
     ar.stack_curr_top = ar.stack_top;	    // expected top (for debugging)
     ar.L = L;
     ar.ci = ci;
-    s = ci->fi->args_info;
-    s_end = s + ci->fi->args_len;
 
     // arg_nr 1 is the first
     index--;
@@ -324,23 +677,24 @@ static int _call_build_parameters(lua_State *L, int index, struct call_info *ci)
     // Check that enough space for arguments (+1 for the return value)
     // is allocated.
     int arg_count = ar.stack_top - index + 1;
-    call_info_check_argcount(ci, arg_count);
+    call_info_check_argcount(ci, MAX(arg_count, plan->arg_count));
 
-    // look at each required parameter for this function.
-    for (arg_nr = 0; s < s_end; arg_nr++) {
+    // look at each required parameter for this function.  A vararg may use
+    // up more than one slot in ci, therefore arg_nr may be ahead of i.
+    for (i=0, arg_nr=0; i < plan->arg_count; i++, arg_nr++) {
+	pa = &plan->args[i];
 	ar.func_arg_nr = arg_nr;
-	ar.ts.module_idx = ci->fi->module_idx;
-	get_next_argument(L, &s, &ar);
-	ar.arg_type = lg_get_ffi_type(ar.ts);
+	ar.ts = pa->ts;
+	ar.arg_flags = pa->arg_flags;
+	ar.arg_type = pa->arg_type;
 
-	idx = ar.arg_type->ffi_type_idx;
-	if (idx == 0) {
+	if (!plan->argtypes[i]) {
 	    LG_MESSAGE(18, "Argument %d (type %s) has no ffi type.\n",
 		arg_nr, FTYPE_NAME(ar.arg_type));
 	    call_info_msg(L, ci, LUAGNOME_ERROR);
 	    luaL_error(L, "call error\n");
 	}
-	ci->argtypes[arg_nr] = LUAGNOME_FFI_TYPE(idx);
+	ci->argtypes[arg_nr] = plan->argtypes[i];
 
 	/* the first "argument" is actually the return value; no more work. */
 	if (arg_nr == 0) {
@@ -352,7 +706,7 @@ static int _call_build_parameters(lua_State *L, int index, struct call_info *ci)
 	if (index+arg_nr > ar.stack_top) {
 	    // If the current (probably last) argument is vararg, this is OK,
 	    // because a vararg doesn't need any extra arguments.
-	    if (strcmp(FTYPE_NAME(ar.arg_type), "vararg")) {
+	    if (!pa->is_vararg) {
 		LG_MESSAGE(19, "More arguments expected -> nil used\n");
 		call_info_msg(L, ci, LUAGNOME_WARNING);
 	    }
@@ -411,11 +765,13 @@ static int _call_build_parameters(lua_State *L, int index, struct call_info *ci)
  * @param L  Lua State
  * @param index  Stack position of the function's first argument.
  * @param ci  Call Info of the called function.
+ * @param plan  The decoded argument spec of the function
  */
-static int _call_return_values(lua_State *L, int index, struct call_info *ci)
+static int _call_return_values(lua_State *L, int index, struct call_info *ci,
+    const struct call_plan *plan)
 {
     int stack_pos = lua_gettop(L), arg_nr, skip=0;
-    const unsigned char *s, *s_end;
+    const struct call_plan_arg *pa;
     struct argconv_t ar;
 
     /* this avoids a load of valgrind errors about "uninitialized memory" */
@@ -426,14 +782,12 @@ static int _call_return_values(lua_State *L, int index, struct call_info *ci)
     ar.mode = ARGCONV_CALL;
 
     /* Return the return value and output arguments.  This requires another
-     * pass at parsing the argument spec. */
-    s = ci->fi->args_info;
-    s_end = s + ci->fi->args_len;
-
-    for (arg_nr = 0; s < s_end; arg_nr++) {
+     * pass over the argument spec. */
+    for (arg_nr = 0; arg_nr < plan->arg_count; arg_nr++) {
+	pa = &plan->args[arg_nr];
 	ar.func_arg_nr = arg_nr;
-	ar.ts.module_idx = ci->fi->module_idx;
-	get_next_argument(L, &s, &ar);
+	ar.ts = pa->ts;
+	ar.arg_flags = pa->arg_flags;
 
 	// ffi2lua_xxx functions may use more than one argument.
 	if (skip) {
@@ -441,7 +795,7 @@ static int _call_return_values(lua_State *L, int index, struct call_info *ci)
 	    continue;
 	}
 
-	ar.arg_type = lg_get_ffi_type(ar.ts);
+	ar.arg_type = pa->arg_type;
 	int idx = ar.arg_type->conv_idx;
 
 	/* The INCREF flag means to increase the refcount of a function's
@@ -476,9 +830,9 @@ static int _call_return_values(lua_State *L, int index, struct call_info *ci)
 	    // no type conversion defined
 	    continue;
 	} else {
-	    // Remove one level of indirections from the type.  This will
-	    // be the output type.
-	    ar.ts = lg_type_modify(L, ar.ts, -1);
+	    // The output type has one level of indirection less; it has been
+	    // determined when building the plan.
+	    ar.ts = pa->out_ts;
 	    if (!ar.ts.value) {
 		printf("could not modify type!\n");
 		continue;
@@ -506,6 +860,33 @@ static int _call_return_values(lua_State *L, int index, struct call_info *ci)
     return lua_gettop(L) - stack_pos;
 }
 
+
+/**
+ * Get the prepared call interface for the function to call.  It is part of
+ * the call plan, except for vararg functions, where the argument types may
+ * differ on each call; for those the temporary cif provided by the caller
+ * is prepared with the argument types determined by _call_build_parameters.
+ *
+ * @param ci  call_info with the argument types set
+ * @param plan  The call plan of the function
+ * @param tmp_cif  Storage for a cif that is only valid for this call
+ * @return  A prepared cif, or NULL on error.
+ */
+static ffi_cif *_call_get_cif(struct call_info *ci, struct call_plan *plan,
+    ffi_cif *tmp_cif)
+{
+    int n = ci->arg_count;
+
+    if (G_LIKELY(!plan->is_vararg))
+	return plan->cif_ok ? &plan->cif : NULL;
+
+    if (ffi_prep_cif(tmp_cif, FFI_DEFAULT_ABI, n - 1, ci->argtypes[0],
+	ci->argtypes + 1) != FFI_OK)
+	return NULL;
+    return tmp_cif;
+}
+
+
 /**
  * Call the given function by name, and use the current Lua stack
  * as parameters.
@@ -543,26 +924,35 @@ int lg_call_function(lua_State *L, const char *mod_name, const char *func_name)
 
 
 /**
- * Call a library function from Lua.  The information about parameters and
- * return values is compiled in (automatically generated). 
+ * Perform one call of a library function using the given call_info, which
+ * must be unused, i.e. fresh from call_info_alloc or reset after the
+ * previous call.
  *
  * @param L  Lua State
  * @param fi  Description of the library function to call
  * @param index  Lua stack position where the first argument is
+ * @param ci  The call_info to use
  * @return  The number of results on the Lua stack
  */
-int lg_call(lua_State *L, struct func_info *fi, int index)
+static int _call_with_info(lua_State *L, struct func_info *fi, int index,
+    struct call_info *ci)
 {
-    struct call_info *ci;
-    ffi_cif cif;
-    int rc = 0;
+    struct call_plan *plan;
+    ffi_cif tmp_cif, *cif;
+    int rc = 0, profile = runtime_flags & RUNTIME_PROFILE;
+    gint64 t_start = 0, t_call = 0, t_return = 0;
+
+    if (G_UNLIKELY(profile))
+	t_start = lg_profile_time();
 
     cmi mi = modules[fi->module_idx];
     if (mi->call_hook)
 	mi->call_hook(L, fi);
 
-    // allocate (or re-use from the pool) a call_info structure.
-    ci = call_info_alloc();
+    plan = fi->plan;
+    if (G_UNLIKELY(!plan))
+	plan = _call_get_plan(L, fi);
+
     ci->fi = fi;
     ci->L = L;
     ci->index = index;
@@ -574,28 +964,152 @@ int lg_call(lua_State *L, struct func_info *fi, int index)
     }
 
     /* call the function */
-    if (_call_build_parameters(L, index, ci)) {
-	if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, ci->arg_count - 1,
-	    ci->argtypes[0], ci->argtypes + 1) == FFI_OK) {
+    if (_call_build_parameters(L, index, ci, plan)) {
+	if ((cif = _call_get_cif(ci, plan, &tmp_cif))) {
 
 	    // A trace function displaying the argument values could be called
 	    // from here.  This doesn't exist yet.
 	    // XXX call_info_trace(ci);
 
+	    if (G_UNLIKELY(profile))
+		t_call = lg_profile_time();
+
 	    struct call_info *tmp = ci_current;
 	    ci_current = ci;
-	    ffi_call(&cif, fi->func, &ci->args[0].ffi_arg, ci->argvalues + 1);
+	    if (plan->stub && !(runtime_flags & RUNTIME_NO_FAST_CALLS))
+		plan->stub(fi->func, ci);
+	    else
+		ffi_call(cif, fi->func, &ci->args[0].ffi_arg,
+		    ci->argvalues + 1);
 	    ci_current = tmp;
 
-	    /* evaluate the return values */
-	    rc = _call_return_values(L, index, ci);
+	    if (G_UNLIKELY(profile))
+		t_return = lg_profile_time();
+
+	    /* evaluate the return values; not required for void functions
+	     * without output arguments. */
+	    if (plan->has_output || !plan->returns_void)
+		rc = _call_return_values(L, index, ci, plan);
 	} else {
 	    return luaL_error(L, "%s FFI call to %s couldn't be initialized.",
 		msgprefix, fi->name);
 	}
     }
 
+    if (G_UNLIKELY(profile))
+	lg_profile_add(lg_profile_get(fi->func, fi->name, 0), t_start, t_call,
+	    t_return, lg_profile_time());
+
+    return rc;
+}
+
+
+/**
+ * Call a library function from Lua.  The information about parameters and
+ * return values is compiled in (automatically generated). 
+ *
+ * @param L  Lua State
+ * @param fi  Description of the library function to call
+ * @param index  Lua stack position where the first argument is
+ * @return  The number of results on the Lua stack
+ */
+int lg_call(lua_State *L, struct func_info *fi, int index)
+{
+    // allocate (or re-use from the pool) a call_info structure.
+    struct call_info *ci = call_info_alloc();
+    int rc = _call_with_info(L, fi, index, ci);
     call_info_free(ci);
     return rc;
 }
 
+
+/**
+ * Call many library functions with one call from Lua.  This saves the
+ * overhead of going through the closure for each function, and all calls
+ * share one call_info.  The functions are called in the given order.
+ *
+ * Each entry of the list is a table with the function as first element,
+ * followed by its arguments, like { lbl.set_text, lbl, "hello" }.  The
+ * function must be a library function as returned by the module or by
+ * methods of objects, not a Lua function.  When an argument is nil, the
+ * number of arguments must be given in the field "n".
+ *
+ * @name batch
+ * @luaparam list  Array of call descriptions
+ * @luareturn  Table with the result of each call at the same index: nothing
+ *   (nil) for functions without return value, the value if there is one, or a
+ *   table with all the values if there are more (output arguments).
+ */
+int lg_call_batch(lua_State *L)
+{
+    struct call_info *ci;
+    struct func_info *fi;
+    int i, j, n, arg_count, rc;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    n = lua_objlen(L, 1);
+    lua_settop(L, 1);
+    lua_createtable(L, n, 0);		    // list results
+
+    ci = call_info_alloc();
+    for (i=1; i<=n; i++) {
+	lua_rawgeti(L, 1, i);		    // list results entry
+	if (G_UNLIKELY(lua_type(L, 3) != LUA_TTABLE)) {
+	    call_info_free(ci);
+	    return luaL_error(L, "%s batch: entry %d is a %s, not a table",
+		msgprefix, i, luaL_typename(L, 3));
+	}
+
+	lua_rawgeti(L, 3, 1);		    // list results entry func
+	fi = lg_get_closure(L, 4);
+	lua_pop(L, 1);
+
+	lua_getfield(L, 3, "n");
+	arg_count = lua_isnumber(L, -1) ? lua_tointeger(L, -1)
+	    : (int) lua_objlen(L, 3) - 1;
+	lua_pop(L, 1);
+	luaL_checkstack(L, arg_count + 1, "too many arguments");
+	for (j=1; j<=arg_count; j++)
+	    lua_rawgeti(L, 3, j + 1);	    // list results entry func args...
+
+	rc = _call_with_info(L, fi, 5, ci);
+
+	if (rc > 1) {
+	    int t = lua_gettop(L) - rc;
+	    lua_createtable(L, rc, 0);
+	    lua_insert(L, t + 1);
+	    for (j=rc; j>0; j--)
+		lua_rawseti(L, t + 1, j);
+	    rc = 1;
+	}
+	if (rc == 1)
+	    lua_rawseti(L, 2, i);
+
+	lua_settop(L, 2);
+	_call_info_release(ci);
+	_call_info_reset(ci);
+    }
+    call_info_free(ci);
+
+    return 1;
+}
+
+
+/**
+ * Statistics about the memory allocated for extra arguments of library
+ * calls and callbacks, e.g. output arguments or arrays.  When the number of
+ * blocks stays the same during a loop, no malloc was required.
+ *
+ * @name get_arena_stats
+ * @luareturn  Number of items allocated
+ * @luareturn  Number of bytes allocated
+ * @luareturn  Number of memory blocks allocated with malloc
+ */
+int lg_call_arena_stats(lua_State *L)
+{
+    lua_pushnumber(L, arena_stats.items);
+    lua_pushnumber(L, arena_stats.bytes);
+    lua_pushnumber(L, arena_stats.blocks);
+    return 3;
+}
+
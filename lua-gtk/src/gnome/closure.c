@@ -29,9 +29,13 @@ struct lua_closure {
     typespec_t ts;			// type of the function
     void *code;				// points to somewhere in closure
     ffi_closure *closure;		// closure allocated by FFI
-    ffi_cif *cif;			// cif - spec of retval/args types
-    ffi_type **arg_types;		// allocated array
+    struct closure_cif *cc;		// cif - spec of retval/args types;
+					// shared, see _get_closure_cif
     int is_automatic;			// true if allocated automatically
+    int call_scoped;			// automatic, and only called during
+					// the library call, see _setup_closure
+    struct call_info *ci;		// the library call of an automatic
+    unsigned int ci_serial;		// closure, and its serial then
 };
 
 // For debugging purposes, when a closure is garbage collected, keep the memory
@@ -39,11 +43,45 @@ struct lua_closure {
 struct closure_keeper {
     struct closure_keeper *next;
     ffi_closure *closure;
-    ffi_cif *cif;
-    ffi_type **arg_types;
 };
 static struct closure_keeper *unused = NULL;
 
+// A prepared ffi_closure that is not in use, see _pool_get.
+struct pooled_closure {
+    struct pooled_closure *next;
+    ffi_closure *closure;
+    void *code;
+};
+
+// at most this many unused closures are kept for each function type
+#define CLOSURE_POOL_MAX 8
+
+// The cif and the argument types for one function type.  All closures of
+// that type share them; they are kept until the program ends.
+struct closure_cif {
+    struct pooled_closure *pool;	// unused closures of this type
+    int pool_count;
+    int automatic_checked;		// set when the fields below are valid
+    int whitelisted;			// type allows automatic closures
+    const char **blacklist;		// NULL or functions that don't
+    ffi_cif cif;
+    ffi_type *arg_types[];		// return value, then the arguments
+};
+
+// user_data of pooled closures; has no valid magic, see closure_handler.
+static struct lua_closure dead_closure;
+
+// counters for gnome.get_closure_stats; protected by cif_lock
+static struct {
+    unsigned long allocated;		// ffi closures allocated
+    unsigned long reused;		// ffi closures taken from a pool
+} closure_stats;
+
+// closure_cif entries keyed by the typespec of the function type.  Shared
+// by all threads and protected by cif_lock.
+static GHashTable *cif_cache = NULL;
+static volatile int cif_lock = 0;
+
 
 /**
  * Call the appropriate function to convert the return value(s) of the Lua
@@ -212,17 +250,31 @@ static void closure_handler(ffi_cif *cif, void *retval, void **args,
 
     // the main test here is on cif.  A new closure might have already been
     // allocated at the same location (*userdata), but in this case even
-    // though it has the same magic signature, the cif pointer will differ.
-    if (cl->magic1 != CLOSURE_MAGIC1 || cl->cif != cif) {
+    // though it has the same magic signature, the cif pointer will differ
+    // unless it is of the same type, i.e. expects the same arguments.
+    if (cl->magic1 != CLOSURE_MAGIC1 || &cl->cc->cif != cif) {
 	fprintf(stderr, "%s closure handler detected a garbage collected "
 		"closure at %p!\n", msgprefix, cl);
 	exit(1);
     }
 
+    // A pooled closure may have been reused for a new automatic closure of
+    // the same type, so the above check can't detect a library that calls
+    // it after its own call has returned; the serial of that call can.
+    if (G_UNLIKELY(cl->call_scoped && cl->ci->serial != cl->ci_serial)) {
+	fprintf(stderr, "%s closure handler detected a call to the automatic "
+	    "closure at %p after its library call returned!\n", msgprefix, cl);
+	exit(1);
+    }
+
     lua_State *L = cl->L;
-    int top = lua_gettop(L);
+    int top = lua_gettop(L), profile = runtime_flags & RUNTIME_PROFILE;
     struct argconv_t ar;
     struct call_info *ci;
+    gint64 t_start = 0, t_call = 0, t_return = 0;
+
+    if (G_UNLIKELY(profile))
+	t_start = lg_profile_time();
 
     // Initialize the argconv_t structure.
     ci = call_info_alloc();
@@ -249,12 +301,21 @@ static void closure_handler(ffi_cif *cif, void *retval, void **args,
 
     // call the lua function, expect any number of return values
     int arg_cnt = lua_gettop(L) - top - 1;
+    if (G_UNLIKELY(profile))
+	t_call = lg_profile_time();
     lua_call(L, arg_cnt, LUA_MULTRET);
+    if (G_UNLIKELY(profile))
+	t_return = lg_profile_time();
     _closure_return_values(L, cl, &ar, top+1, args, retval);
 
     // clean up
     lua_settop(L, top);
     call_info_free(ci);
+
+    if (G_UNLIKELY(profile))
+	lg_profile_add(lg_profile_get(lg_get_prototype(cl->ts),
+	    lg_get_type_name(cl->ts), 1), t_start, t_call, t_return,
+	    lg_profile_time());
 }
 
 
@@ -290,18 +351,118 @@ static int set_ffi_types(lua_State *L, typespec_t ts, ffi_type **arg_types)
     return arg_nr;
 }
 
-// really free all memory of the closure.
-static void _free_closure(ffi_closure *closure, ffi_cif *cif,
-    ffi_type **arg_types)
+/**
+ * Get the cif for closures of the given function type.  It is prepared the
+ * first time a closure of this type is used.
+ */
+static struct closure_cif *_get_closure_cif(lua_State *L, typespec_t ts)
+{
+    struct closure_cif *cc, *new_cc;
+    int arg_count;
+
+    ts.flag = 0;
+    LG_LOCK(cif_lock);
+    if (G_UNLIKELY(!cif_cache))
+	cif_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+    cc = (struct closure_cif*) g_hash_table_lookup(cif_cache,
+	GUINT_TO_POINTER(ts.value));
+    LG_UNLOCK(cif_lock);
+    if (G_LIKELY(cc))
+	return cc;
+
+    // The count includes the return value, and therefore must be at least 1.
+    arg_count = set_ffi_types(L, ts, NULL);
+    if (arg_count <= 0)
+	luaL_error(L, "_setup_closure: invalid signature");
+
+    // fill arg_types, then ffi_cif.  This is done without the lock, as
+    // set_ffi_types may raise a Lua error.
+    new_cc = (struct closure_cif*) g_malloc0(sizeof(*new_cc)
+	+ sizeof(ffi_type*) * arg_count);
+    set_ffi_types(L, ts, new_cc->arg_types);
+    ffi_prep_cif(&new_cc->cif, FFI_DEFAULT_ABI, arg_count-1,
+	new_cc->arg_types[0], new_cc->arg_types+1);
+
+    // another thread might have been faster.
+    LG_LOCK(cif_lock);
+    cc = (struct closure_cif*) g_hash_table_lookup(cif_cache,
+	GUINT_TO_POINTER(ts.value));
+    if (!cc) {
+	g_hash_table_insert(cif_cache, GUINT_TO_POINTER(ts.value), new_cc);
+	cc = new_cc;
+	new_cc = NULL;
+    }
+    LG_UNLOCK(cif_lock);
+
+    if (new_cc)
+	g_free(new_cc);
+    return cc;
+}
+
+
+/**
+ * Take an unused closure of the right type from the pool and bind it to the
+ * given lua_closure.
+ *
+ * @return  1 on success, 0 if the pool is empty.
+ */
+static int _pool_get(struct lua_closure *cl)
 {
-    ffi_closure_free(closure);
+    struct closure_cif *cc = cl->cc;
+    struct pooled_closure *p;
+
+    LG_LOCK(cif_lock);
+    p = cc->pool;
+    if (p) {
+	cc->pool = p->next;
+	cc->pool_count --;
+    }
+    LG_UNLOCK(cif_lock);
+
+    if (!p)
+	return 0;
+
+    LG_LOCK(cif_lock);
+    closure_stats.reused ++;
+    LG_UNLOCK(cif_lock);
+
+    // the cif and the handler are already set, just change the user_data.
+    cl->closure = p->closure;
+    cl->code = p->code;
+    cl->closure->user_data = (void*) cl;
+    g_slice_free(struct pooled_closure, p);
+    return 1;
+}
+
 
-    if (cif) {
-	memset(cif, 0, sizeof(*cif));
-	g_free(cif);
+/**
+ * Put the closure of a lua_closure that is being garbage collected into the
+ * pool of its type.
+ *
+ * @return  1 on success, 0 if the pool is full.
+ */
+static int _pool_put(struct lua_closure *cl)
+{
+    struct closure_cif *cc = cl->cc;
+    struct pooled_closure *p = g_slice_new(struct pooled_closure);
+
+    p->closure = cl->closure;
+    p->code = cl->code;
+    p->closure->user_data = (void*) &dead_closure;
+
+    LG_LOCK(cif_lock);
+    if (cc->pool_count < CLOSURE_POOL_MAX) {
+	p->next = cc->pool;
+	cc->pool = p;
+	cc->pool_count ++;
+	p = NULL;
     }
-    if (arg_types)
-	g_free(arg_types);
+    LG_UNLOCK(cif_lock);
+
+    if (!p)
+	return 1;
+    g_slice_free(struct pooled_closure, p);
+    return 0;
 }
 
 
@@ -315,13 +476,14 @@ static int l_closure_gc(lua_State *L)
 
     if (cl->closure) {
 	if (!(runtime_flags & RUNTIME_DEBUG_CLOSURES)) {
-	    _free_closure(cl->closure, cl->cif, cl->arg_types);
+	    // call scoped closures are only called during the library call;
+	    // they can be reused.
+	    if (!cl->call_scoped || !_pool_put(cl))
+		ffi_closure_free(cl->closure);
 	} else {
 	    struct closure_keeper *k = g_slice_alloc(sizeof(*k));
 	    k->next = unused;
 	    k->closure = cl->closure;
-	    k->cif = cl->cif;
-	    k->arg_types = cl->arg_types;
 	    unused = k;
 	}
     }
@@ -378,7 +540,21 @@ static const luaL_reg closure_methods[] = {
     { NULL, NULL }
 };
 
-#ifdef LUAGNOME_DEBUG_FUNCS
+/**
+ * Return counters about the ffi closures of automatic closures.  When the
+ * number of allocated closures stays the same during a loop, the closures
+ * were taken from the pool.
+ *
+ * @name get_closure_stats
+ * @luareturn  Number of ffi closures allocated
+ * @luareturn  Number of ffi closures reused from the pool
+ */
+static int l_get_closure_stats(lua_State *L)
+{
+    lua_pushnumber(L, closure_stats.allocated);
+    lua_pushnumber(L, closure_stats.reused);
+    return 2;
+}
 
 
 // There are about 200 functions that have a function pointer as argument.
@@ -441,17 +617,20 @@ static const char _check_types_whitelist[] =
 
 
 // Here are functions that have one of the above arguments types, but still
-// can't be called with automatic closures.  Listed behind each function is
+// can't be called with automatic closures.  Each function is followed by
 // the offending data type.
 static const char _check_funcs_blacklist[] =
-    "g_tree_new\0"				// GCompareFunc
-    "g_tree_new_full\0"				// GCompareDataFunc
-    "g_tree_new_with_data\0"			// GCompareDataFunc
-    "g_thread_pool_set_sort_function\0"		// GCompareDataFunc
-    "g_thread_pool_new\0"			// GFunc
-    "g_cache_new\0"				// GHashFunc, GEqualFunc
-    "g_hash_table_new\0"			// GHashFunc, GEqualFunc
-    "g_hash_table_new_full\0"			// GHashFunc, GEqualFunc
+    "g_tree_new\0" "GCompareFunc\0"
+    "g_tree_new_full\0" "GCompareDataFunc\0"
+    "g_tree_new_with_data\0" "GCompareDataFunc\0"
+    "g_thread_pool_set_sort_function\0" "GCompareDataFunc\0"
+    "g_thread_pool_new\0" "GFunc\0"
+    "g_cache_new\0" "GHashFunc\0"
+    "g_cache_new\0" "GEqualFunc\0"
+    "g_hash_table_new\0" "GHashFunc\0"
+    "g_hash_table_new\0" "GEqualFunc\0"
+    "g_hash_table_new_full\0" "GHashFunc\0"
+    "g_hash_table_new_full\0" "GEqualFunc\0"
 ;
 
 static int _list_search(const char *list, const char *s)
@@ -470,6 +649,68 @@ static int _list_search(const char *list, const char *s)
 }
 
 
+/**
+ * Look up the function type in the white and black lists.  This is done
+ * once for each function type; the result is stored in the closure_cif.
+ */
+static void _resolve_automatic(struct closure_cif *cc, const char *type_name)
+{
+    const char *list, *func, **blacklist = NULL;
+    int whitelisted, n = 0;
+
+    whitelisted = _list_search(_check_types_whitelist, type_name);
+
+    // collect the functions listed with this type
+    for (list=_check_funcs_blacklist; *list; list += strlen(list) + 1) {
+	func = list;
+	list += strlen(list) + 1;
+	if (strcmp(list, type_name))
+	    continue;
+	blacklist = (const char**) g_realloc(blacklist, sizeof(*blacklist)
+	    * (n + 2));
+	blacklist[n++] = func;
+	blacklist[n] = NULL;
+    }
+
+    LG_LOCK(cif_lock);
+    if (!cc->automatic_checked) {
+	cc->whitelisted = whitelisted;
+	cc->blacklist = blacklist;
+	cc->automatic_checked = 1;
+	blacklist = NULL;
+    }
+    LG_UNLOCK(cif_lock);
+
+    if (blacklist)
+	g_free(blacklist);
+}
+
+
+/**
+ * Is the closure only called during the library call it is given to?  This
+ * is the case if its type is in the whitelist, and the function not in the
+ * blacklist.
+ */
+static int _is_call_scoped(struct lua_closure *cl, const char *func_name)
+{
+    struct closure_cif *cc = cl->cc;
+    const char **func;
+
+    if (G_UNLIKELY(!cc->automatic_checked))
+	_resolve_automatic(cc, lg_get_type_name(cl->ts));
+
+    if (!cc->whitelisted)
+	return 0;
+    if (!cc->blacklist)
+	return 1;
+    for (func=cc->blacklist; *func; func++)
+	if (!strcmp(*func, func_name))
+	    return 0;
+    return 1;
+}
+
+#ifdef LUAGNOME_DEBUG_FUNCS
+
 /**
  * Disallow the usage of automatic closures, which are created on-the-fly
  * and destroyed after the called function returns, in certain situations.
@@ -477,15 +718,8 @@ static int _list_search(const char *list, const char *s)
 static void _check_automatic(lua_State *L, struct lua_closure *cl,
     int arg_nr, const char *func_name)
 {
-    // not an automatic closure - ok
-    if (!cl->is_automatic)
-	return;
-
-    // make sure the type is in the whitelist, and the function not in the
-    // blacklist.
-    const char *type_name = lg_get_type_name(cl->ts);
-    if (_list_search(_check_types_whitelist, type_name)
-	&& !_list_search(_check_funcs_blacklist, func_name))
+    // not an automatic closure, or one that may be used here - ok
+    if (!cl->is_automatic || cl->call_scoped)
 	return;
 
     // can't do it.
@@ -493,7 +727,7 @@ static void _check_automatic(lua_State *L, struct lua_closure *cl,
 	luaL_argerror(L, arg_nr, "Can't use an automatic closure here");
     else
 	luaL_error(L, "%s Can't use an automatic closure for type %s",
-	    msgprefix, type_name);
+	    msgprefix, lg_get_type_name(cl->ts));
 }
 
 #else
@@ -508,30 +742,24 @@ static void _check_automatic(lua_State *L, struct lua_closure *cl,
 static void _setup_closure(lua_State *L, struct lua_closure *cl,
     typespec_t ts, int arg_nr, const char *func_name)
 {
-    int arg_count;
-
     // check that a temporary closure isn't used for one of the known
     // callback types.
     cl->ts = ts;
+    cl->cc = _get_closure_cif(L, ts);
+    if (cl->is_automatic)
+	cl->call_scoped = _is_call_scoped(cl, func_name);
     _check_automatic(L, cl, arg_nr, func_name);
 
     // cl->sig = lg_get_prototype(ts);
+    if (cl->call_scoped && _pool_get(cl))
+	return;
     cl->closure = (ffi_closure*) ffi_closure_alloc(sizeof(*cl->closure),
 	&cl->code);
-    cl->cif = (ffi_cif*) g_malloc(sizeof(*cl->cif));
-
-    // The count includes the return value, and therefore must be at least 1.
-    arg_count = set_ffi_types(L, ts, NULL);
-    if (arg_count <= 0)
-	luaL_error(L, "_setup_closure: invalid signature");
-
-    // allocate and fill arg_types, then ffi_cif
-    cl->arg_types = (ffi_type**) g_malloc(sizeof(ffi_type*) * arg_count);
-    set_ffi_types(L, ts, cl->arg_types);
-    ffi_prep_cif(cl->cif, FFI_DEFAULT_ABI, arg_count-1, cl->arg_types[0],
-	cl->arg_types+1);
-    ffi_prep_closure_loc(cl->closure, cl->cif, closure_handler, (void*) cl,
-	cl->code);
+    LG_LOCK(cif_lock);
+    closure_stats.allocated ++;
+    LG_UNLOCK(cif_lock);
+    ffi_prep_closure_loc(cl->closure, &cl->cc->cif, closure_handler,
+	(void*) cl, cl->code);
 }
 
 
@@ -586,7 +814,7 @@ void *lg_use_closure(lua_State *L, int index, typespec_t ts, int arg_nr,
 static int l_closure(lua_State *L)
 {
     luaL_checktype(L, 1, LUA_TFUNCTION);
-    return lg_create_closure(L, 1, 0);
+    return lg_create_closure(L, 1, NULL);
 }
 
 /**
@@ -596,10 +824,10 @@ static int l_closure(lua_State *L)
  *
  * @param L  Lua State
  * @param index  Position on the Lua stack where the function object is
- * @param is_automatic  The corresponding field in the new closure is set to
- *  this value.
+ * @param ci  For an automatic closure, the library call it is given to;
+ *  NULL for closures created by gnome.closure.
  */
-int lg_create_closure(lua_State *L, int index, int is_automatic)
+int lg_create_closure(lua_State *L, int index, struct call_info *ci)
 {
     struct lua_closure *cl = (struct lua_closure*) lua_newuserdata(L,
 	sizeof(*cl));
@@ -612,7 +840,11 @@ int lg_create_closure(lua_State *L, int index, int is_automatic)
 
     cl->magic1 = CLOSURE_MAGIC1;
     cl->L = L;
-    cl->is_automatic = is_automatic;
+    cl->is_automatic = ci != NULL;
+    if (ci) {
+	cl->ci = ci;
+	cl->ci_serial = ci->serial;
+    }
     lua_pushvalue(L, index);
     cl->func_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
@@ -625,6 +857,7 @@ int lg_create_closure(lua_State *L, int index, int is_automatic)
 // additional functions in gnome
 static const luaL_reg closure_functions[] = {
     { "closure",    l_closure },
+    { "get_closure_stats", l_get_closure_stats },
     { NULL, NULL }
 };
 
@@ -647,7 +880,7 @@ void lg_done_closure()
     while (unused) {
 	k = unused;
 	unused = k->next;
-	_free_closure(k->closure, k->cif, k->arg_types);
+	ffi_closure_free(k->closure);
 	g_slice_free(struct closure_keeper, k);
     }
 }
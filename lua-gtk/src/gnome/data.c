@@ -15,6 +15,7 @@
  *   lg_find_constant
  *   lg_find_func
  *   lg_find_struct
+ *   lg_find_struct_gtype
  *   lg_find_global
  *   lg_get_type_info
  *   lg_get_ffi_type
@@ -33,8 +34,33 @@
 struct module_info **modules;		// modules - [0] is unused!
 int module_count;			// number of loaded modules
 static int module_alloc;		// allocation size of global modules
+
+// Per module, the resolved typespecs of its non-native types indexed by
+// type_idx; zero while not resolved yet.  See lg_type_normalize.
+static typespec_t **normalized;
+
+// The type map: hash value of the full name of each native type of all
+// loaded modules -> typespec_t, sorted by hash value for a binary search.
+// It is shared by all Lua states.
+struct typemap_entry {
+    unsigned int hash_value;
+    typespec_t ts;
+};
+static struct typemap_entry *typemap = NULL;
+static int typemap_count = 0;
+
+// Memo of lg_find_struct_gtype: GType (plus indirections) -> typespec_t,
+// or TS_NOT_FOUND.  Cleared when a module is loaded.
+static GHashTable *gtype_memo = NULL;
+#define TS_NOT_FOUND 0xffffffff
+
+// protects typemap and gtype_memo
+static volatile int typemap_lock = 0;
 const struct module_info *curr_module;	// needed for qsort and bsearch
 
+static void *_find_my_handle(lua_State *L);
+static void _dl_load(struct dynlink *dyn);
+
 // only works for native types!
 #define TYPE_NAME(mi, ti) ((mi)->type_names + (ti)->st.name_ofs)
 
@@ -342,9 +368,39 @@ int lg_type_equal(lua_State *L, typespec_t ts1, typespec_t ts2)
 }
 
 
+/**
+ * Look up a type by the hash value of its full name.
+ *
+ * @return  The typespec, which is zero when not found.
+ */
+static typespec_t _typemap_lookup(unsigned int hash_value)
+{
+    typespec_t ts = { 0 };
+    int lo = 0, hi, mid;
+
+    LG_LOCK(typemap_lock);
+    hi = typemap_count - 1;
+    while (lo <= hi) {
+	mid = (lo + hi) >> 1;
+	if (typemap[mid].hash_value == hash_value) {
+	    ts = typemap[mid].ts;
+	    break;
+	}
+	if (typemap[mid].hash_value < hash_value)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+    LG_UNLOCK(typemap_lock);
+
+    return ts;
+}
+
+
 /**
  * If a typespec refers to a "non-native" type, use the hash value stored
- * there to look up the type in the table gnome.typemap.
+ * there to look up the type in the type map.  The result is
+ * remembered, so that this happens only once for each non-native type.
  */
 typespec_t lg_type_normalize(lua_State *L, typespec_t ts)
 {
@@ -354,17 +410,16 @@ typespec_t lg_type_normalize(lua_State *L, typespec_t ts)
     if (ti->st.genus != GENUS_NON_NATIVE)
 	return ts;
 
-    lua_getglobal(L, lib_name);
-    lua_getfield(L, -1, "typemap");
-    lua_pushinteger(L, ti->nn.name_hash);
-    lua_rawget(L, -2);
-    if (!lua_isnil(L, -1)) {
-found:;	typespec_t ts2;
-	ts2.value = lua_tointeger(L, -1);
-	lua_pop(L, 3);
+    typespec_t *cached = normalized[ts.module_idx] + ts.type_idx, ts2;
+    if (G_LIKELY(cached->value))
+	return *cached;
+
+    ts2 = _typemap_lookup(ti->nn.name_hash);
+    if (ts2.value) {
+found:
+	*cached = ts2;
 	return ts2;
     }
-    lua_pop(L, 1);
 
     cmi mi = modules[ts.module_idx];
 
@@ -378,9 +433,8 @@ found:;	typespec_t ts2;
 	lua_call(L, 1, 0);
 	
 	// try again
-	lua_pushinteger(L, ti->nn.name_hash);
-	lua_rawget(L, -2);
-	if (!lua_isnil(L, -1))
+	ts2 = _typemap_lookup(ti->nn.name_hash);
+	if (ts2.value)
 	    goto found;
 	
 	// still not found; should not happen.
@@ -544,8 +598,33 @@ const struct struct_elem *find_attribute(typespec_t ts, const char *attr_name)
     type_info_t ti = mi->type_list + ts.type_idx;
     const char *name;
 
-    /* Search up to the start of the next entry. */
     e = mi->elem_list + ti->st.elem_start;
+
+    /* Binary search using the name index, which modules built for API
+     * version 0.14 or later have (0.12 and 0.13 have it at a different
+     * offset).  Finds the first of equal names. */
+    if (G_LIKELY(mi->minor >= 14 && mi->elem_sorted)) {
+	const unsigned char *idx = mi->elem_sorted + ti->st.elem_start;
+	int lo = 0, hi = ti->st.elem_count, mid;
+
+	while (lo < hi) {
+	    mid = (lo + hi) / 2;
+	    name = lg_get_struct_elem_name(ts.module_idx, e + idx[mid]);
+	    if (strcmp(name, attr_name) < 0)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+
+	if (lo < ti->st.elem_count) {
+	    name = lg_get_struct_elem_name(ts.module_idx, e + idx[lo]);
+	    if (!strcmp(name, attr_name))
+		return e + idx[lo];
+	}
+	return NULL;
+    }
+
+    /* Search up to the start of the next entry. */
     e_end = e + ti->st.elem_count;
 
     for (; e < e_end; e++) {
@@ -592,13 +671,15 @@ void lg_create_fundamental_map(lua_State *L)
 /**
  * Each module lists fundamental names' hash values which are used here to
  * build a mapping for fundamental types.
+ *
+ * @return  The new mapping, or NULL if some types were not found.
  */
-static void _map_fundamental_names(lua_State *L, struct module_info *mi)
+static int *_map_fundamental_names(lua_State *L, struct module_info *mi)
 {
     int cnt = mi->fundamental_count, err=0, i;
     unsigned int hash_value;
 
-    int *map = mi->fundamental_map = (int*) g_malloc(sizeof(*map) * (cnt+1));
+    int *map = (int*) g_malloc(sizeof(*map) * (cnt+1));
     map[0] = 0;	// "INVALID" is the first entry, not stored in module list
 
     lua_getglobal(L, lib_name);
@@ -619,9 +700,11 @@ static void _map_fundamental_names(lua_State *L, struct module_info *mi)
     }
 
     lua_pop(L, 2);
-    if (err > 0)
-	luaL_error(L, "%s errors while resolving fundamental types in module %s",
-	    msgprefix, mi->name);
+    if (err) {
+	g_free(map);
+	return NULL;
+    }
+    return map;
 }
 
 
@@ -659,82 +742,150 @@ static void _map_fundamental_names(lua_State *L, struct module_info *mi)
 
 #endif
 
+static int _type_hash_compare(const void *a, const void *b)
+{
+    unsigned int h1 = ((const struct type_hash*) a)->hash_value;
+    unsigned int h2 = ((const struct type_hash*) b)->hash_value;
+    return h1 < h2 ? -1 : h1 > h2;
+}
+
 /**
- * Add all native types of this module to the global hash list of types.
+ * Modules built for an API version before 0.14 don't provide the hash values
+ * of their types; compute them here, like script/xml-output.lua does.
+ *
+ * @return  A list sorted by hash value and terminated by a zero type_idx;
+ *   free it with g_free.
  */
-static void _update_typemap_hash(lua_State *L, struct module_info *mi)
+static struct type_hash *_compute_type_hashes(cmi mi)
 {
     type_info_t ti;
     struct hash_state state;
+    struct type_hash *list;
     char full_name[LG_TYPE_NAME_LENGTH];
-    unsigned int hash_value;
-    int type_idx, len, err=0;
-    typespec_t ts = { 0 };
+    int type_idx, len, n = 0;
 
-    lua_getglobal(L, lib_name);
-    lua_getfield(L, -1, "typemap");
-    ts.module_idx = mi->module_idx;
     state.hashfunc = HASHFUNC_JENKINS;
     state.seed = 0; // arbitrary value; must match script/xml-output.lua
+    list = (struct type_hash*) g_malloc(sizeof(*list) * (mi->type_count + 1));
 
     for (type_idx=1; type_idx<=mi->type_count; type_idx++) {
 	ti = mi->type_list + type_idx;
 	if (ti->st.genus == GENUS_NON_NATIVE)
 	    continue;
 	len = _get_type_name_full(mi, ti, full_name);
-	hash_value = compute_hash(&state, (unsigned char*) full_name, len,
-	    NULL);
-	lua_pushinteger(L, hash_value);
+	list[n].hash_value = compute_hash(&state, (unsigned char*) full_name,
+	    len, NULL);
+	list[n++].type_idx = type_idx;
+    }
 
-	// is this hash value (as key) already in the type map?
-	lua_rawget(L, -2);
-	if (!lua_isnil(L, -1)) {
+    qsort(list, n, sizeof(*list), _type_hash_compare);
+    list[n].type_idx = 0;
+    return list;
+}
+
+/**
+ * Add all native types of this module to the global type map.  The hash
+ * values of the type names are precomputed and sorted by
+ * script/xml-output.lua, so this is a merge of two sorted lists.
+ *
+ * This is done once for each module, with module_lock held; therefore
+ * no Lua errors may be raised.
+ *
+ * @return  The number of errors (hash collisions).
+ */
+static int _update_typemap_hash(struct module_info *mi)
+{
+    const struct type_hash *list;
+    struct type_hash *computed = NULL;
+    struct typemap_entry *map, *old;
+    char full_name[LG_TYPE_NAME_LENGTH];
+    int count, i = 0, j = 0, n = 0, err = 0;
+    typespec_t ts = { 0 };
+
+    list = mi->minor >= 14 ? mi->type_hash : NULL;
+    if (!list)
+	list = computed = _compute_type_hashes(mi);
+    for (count=0; list[count].type_idx; count++)
+	;
+
+    ts.module_idx = mi->module_idx;
+
+    LG_LOCK(typemap_lock);
+    old = typemap;
+    map = (struct typemap_entry*) g_malloc(sizeof(*map)
+	* (typemap_count + count));
+
+    while (i < typemap_count || j < count) {
+	if (j == count || (i < typemap_count
+	    && old[i].hash_value < list[j].hash_value)) {
+	    map[n++] = old[i++];
+	    continue;
+	}
+
+	ts.type_idx = list[j].type_idx;
+
+	// is this hash value already in the type map?
+	if (i < typemap_count && old[i].hash_value == list[j].hash_value) {
 	    // yes.  if this is a fundamental type, that's ok.
-	    if (ti->st.genus == GENUS_FUNDAMENTAL) {
-		lua_pop(L, 1);
-		continue;
+	    if (mi->type_list[ts.type_idx].st.genus != GENUS_FUNDAMENTAL) {
+		// normal type - must not occur twice.
+		_get_type_name_full(mi, mi->type_list + ts.type_idx,
+		    full_name);
+		printf("Hash collision for type %d=%s with %s.%d=%s, "
+		    "hash %08x\n", ts.type_idx, full_name,
+		    modules[old[i].ts.module_idx]->name, old[i].ts.type_idx,
+		    lg_get_type_name(old[i].ts), old[i].hash_value);
+		err ++;
+		old[i].ts = ts;
 	    }
-	    // normal type - must not occur twice.
-	    typespec_t ts2 = { lua_tointeger(L, -1) };
-	    printf("Hash collision for type %d=%s with %s.%d=%s, hash %08x\n",
-		type_idx, full_name,
-		modules[ts2.module_idx]->name, ts2.type_idx,
-		lg_get_type_name(ts2),
-		hash_value);
-	    err ++;
+	    map[n++] = old[i++];
+	    j ++;
+	    continue;
 	}
-	lua_pop(L, 1);
 
-	// add to the typemap
-	ts.type_idx = type_idx;
-	lua_pushinteger(L, hash_value);
-	lua_pushinteger(L, ts.value);
-	unsigned int hash_value2 = lua_tointeger(L, -2);
-	if (hash_value != hash_value2)
-	    printf("ERROR %08x %08x\n", hash_value, hash_value2);
-	lua_rawset(L, -3);
-	// printf("typemap %s -> %08x\n", full_name, hash_value);
+	map[n].hash_value = list[j].hash_value;
+	map[n++].ts = ts;
+	j ++;
     }
 
-    // remove gnome._typemap and gnome
-    lua_pop(L, 2);
-    if (err > 0)
-	luaL_error(L, "%s Errors during typemap construction for module %s",
-	    msgprefix, mi->name);
+    typemap = map;
+    typemap_count = n;
+
+    // types not found so far might be available now.
+    if (gtype_memo) {
+	g_hash_table_destroy(gtype_memo);
+	gtype_memo = NULL;
+    }
+    LG_UNLOCK(typemap_lock);
+
+    g_free(old);
+    g_free(computed);
+    return err;
 }
 
 
+/* protects modules[] and the module_idx of the modules */
+static volatile int module_lock = 0;
+
 /**
  * Add a module to the module list.
  * This also creates a global table for that module:
  *  { new, new_array, _modinfo }
  *
+ * A module may be used by several Lua states (e.g. in different threads).
+ * It is added to the module list only once, while the global table and the
+ * type map entries are created in each Lua state.  The module's table is
+ * stored in the registry with the module_info as key.
+ *
  * @luaparam module_name
  */
 int lg_register_module(lua_State *L, struct module_info *mi)
 {
-    if (mi->module_idx)
+    lua_pushlightuserdata(L, mi);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    if (!lua_isnil(L, -1))
 	return LG_ERROR(1, "Can't register module %s twice.", mi->name);
+    lua_pop(L, 1);
 
     // check API version compatibility
     if (mi->major != LUAGNOME_MODULE_MAJOR || mi->minor > LUAGNOME_MODULE_MINOR)
@@ -754,29 +905,64 @@ int lg_register_module(lua_State *L, struct module_info *mi)
 	}
     }
 
-    lg_dl_init(L, &mi->dynlink);
+    // The first Lua state to load this module loads its libraries, assigns
+    // the module_idx and adds its types to the type map.  The Lua API can't
+    // be used while the lock is held, as an error would leave it locked;
+    // therefore the lookups are done before, and rechecked under the lock.
+    int typemap_err = 0, *fundamental_map = NULL;
+    void *self_handle = NULL;
+    if (!mi->module_idx) {
+	fundamental_map = _map_fundamental_names(L, mi);
+	if (!fundamental_map)
+	    return luaL_error(L, "%s errors while resolving fundamental types "
+		"in module %s", msgprefix, mi->name);
+	self_handle = _find_my_handle(L);
+    }
 
-    _map_fundamental_names(L, mi);
+    LG_LOCK(module_lock);
+    if (!mi->module_idx) {
+	mi->dynlink.dl_self_handle = self_handle;
+	_dl_load(&mi->dynlink);
+	mi->fundamental_map = fundamental_map;
+	fundamental_map = NULL;
+
+	// add to pointer array modules[].  Note that it is 1-based, and
+	// therefore one dummy entry is allocated at the beginning.  Other
+	// threads read modules[] and normalized[] without the lock, so
+	// larger arrays are published instead of reallocating them; the old
+	// ones are never freed.
+	if (module_alloc <= module_count + 1) {
+	    int n = module_alloc + 10;
+	    struct module_info **new_modules = (struct module_info**)
+		g_malloc0(n * sizeof(*new_modules));
+	    typespec_t **new_normalized = (typespec_t**) g_malloc0(n
+		* sizeof(*new_normalized));
+	    if (module_alloc) {
+		memcpy(new_modules, modules, module_alloc * sizeof(*modules));
+		memcpy(new_normalized, normalized, module_alloc
+		    * sizeof(*normalized));
+	    }
+	    __sync_synchronize();
+	    modules = new_modules;
+	    normalized = new_normalized;
+	    module_alloc = n;
+	}
+	normalized[module_count + 1] = (typespec_t*) g_malloc0(
+	    (mi->type_count + 1) * sizeof(**normalized));
+	modules[module_count + 1] = mi;
+	__sync_synchronize();
+	mi->module_idx = ++ module_count;
 
-    // add to pointer array modules[].  Note that it is 1-based, and therefore
-    // one dummy entry is allocated at the beginning.
-    if (module_alloc <= module_count + 1) {
-	module_alloc += 10;
-	modules = (struct module_info**) g_realloc(modules, module_alloc
-	    * sizeof(*modules));
-	modules[0] = NULL;
+	typemap_err = _update_typemap_hash(mi);
     }
-    modules[++ module_count] = mi;
-    mi->module_idx = module_count;
+    LG_UNLOCK(module_lock);
 
-    // update all typemaps if at least two modules are loaded now.
-    // XXX modules with more than one library are updated multiple times
-    /*
-    if (module_count > 1)
-	for (i=1; i<=module_count; i++)
-	    _update_typemap(L, modules[i]);
-    */
-    _update_typemap_hash(L, mi);
+    // another thread has registered the module meanwhile
+    g_free(fundamental_map);
+
+    if (typemap_err > 0)
+	return luaL_error(L, "%s Errors during typemap construction for "
+	    "module %s", msgprefix, mi->name);
 
     // create the new global variable
     luaL_register(L, mi->name, mi->methods);
@@ -787,9 +973,14 @@ int lg_register_module(lua_State *L, struct module_info *mi)
     // set it to be its own metatable, so that __index etc. works
     lua_pushvalue(L, -1);
     lua_setmetatable(L, -2);
+    lg_method_cache_watch(L, 1);
 
-    lua_pushvalue(L, -1);
-    mi->module_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pushlightuserdata(L, mi);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // methods not found so far might be available now.
+    __sync_fetch_and_add(&lg_method_cache_generation, 1);
 
 #ifdef LUAGNOME_DEBUG_FUNCS
     // add _modinfo, which is required for debugging.
@@ -810,7 +1001,7 @@ struct module_info *lg_find_module(const char *name)
     int i;
     struct module_info *mi;
 
-    for (i=1; i<module_count; i++) {
+    for (i=1; i<=module_count; i++) {
 	mi = modules[i];
 	if (!strcmp(mi->name, name))
 	    return mi;
@@ -831,25 +1022,73 @@ struct module_info *lg_find_module(const char *name)
  */
 typespec_t lg_find_struct(lua_State *L, const char *type_name, int indirections)
 {
-    char buf[80], *s;
+    char buf[LG_TYPE_NAME_LENGTH];
+    typespec_t ts = { 0 };
+    int len;
+
+    if (!indirections)
+	return lg_get_type(L, type_name);
 
     // build the complete name with the indirections.  Doesn't consider
     // const, array and the like.
-    strcpy(buf, type_name);
-    s = buf + strlen(buf);
-    while (indirections > 0) {
-	*s++ = '*';
-	indirections --;
-    }
-    *s = 0;
+    len = strlen(type_name);
+    if (len + indirections >= sizeof(buf))
+	return ts;
+    memcpy(buf, type_name, len);
+    memset(buf + len, '*', indirections);
+    buf[len + indirections] = 0;
 
     return lg_get_type(L, buf);
 }
 
+/**
+ * Like lg_find_struct, but for a type registered with GLib.  Type names are
+ * looked up and hashed only once per GType, which helps for the few types
+ * seen again and again, e.g. in signal handlers.
+ *
+ * @param type  The GType to look for
+ * @param indirections  0 or 1
+ * @return  The typespec, or zero if not found.
+ */
+typespec_t lg_find_struct_gtype(lua_State *L, GType type, int indirections)
+{
+    // GTypes are either fundamental types shifted by two bits, or pointers;
+    // the lowest bit is free.
+    gpointer key = GSIZE_TO_POINTER(type | indirections);
+    const char *type_name;
+    typespec_t ts;
+
+    LG_LOCK(typemap_lock);
+    ts.value = gtype_memo ? GPOINTER_TO_UINT(g_hash_table_lookup(gtype_memo,
+	key)) : 0;
+    LG_UNLOCK(typemap_lock);
+
+    if (G_LIKELY(ts.value)) {
+	if (ts.value == TS_NOT_FOUND)
+	    ts.value = 0;
+	return ts;
+    }
+
+    type_name = g_type_name(type);
+    ts = type_name ? lg_find_struct(L, type_name, indirections) : ts;
+
+    LG_LOCK(typemap_lock);
+    if (!gtype_memo)
+	gtype_memo = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_insert(gtype_memo, key, GUINT_TO_POINTER(ts.value
+	? ts.value : TS_NOT_FOUND));
+    LG_UNLOCK(typemap_lock);
+
+    return ts;
+}
+
+/**
+ * Find a type by its full name, e.g. "GtkWidget*".  The Lua state isn't
+ * used and may be NULL.
+ */
 typespec_t lg_get_type(lua_State *L, const char *type_name)
 {
     struct hash_state state;
-    typespec_t ts = { 0 };
     unsigned int hash_value;
 
     state.hashfunc = HASHFUNC_JENKINS;
@@ -857,15 +1096,7 @@ typespec_t lg_get_type(lua_State *L, const char *type_name)
     hash_value = compute_hash(&state, (unsigned char*) type_name,
 	strlen(type_name), NULL);
 
-    lua_getglobal(L, lib_name);
-    lua_getfield(L, -1, "typemap");
-    lua_pushinteger(L, hash_value);
-    lua_rawget(L, -2);
-    if (!lua_isnil(L, -1))
-	ts.value = lua_tointeger(L, -1);
-
-    lua_pop(L, 3);
-    return ts;
+    return _typemap_lookup(hash_value);
 }
 
 
@@ -1021,11 +1252,13 @@ static void *dll_load(struct dynlink *dyn, const char *name)
  * almost inaccessible location: in the registry with a key that is
  * a string derived from the full path name of the dynamic library.
  *
- * If the handle can be found, it is stored in dyn->dl_self_handle.
+ * @return  The handle, or NULL if not found; to be stored in
+ *   dyn->dl_self_handle.
  */
-static int _find_my_handle(lua_State *L, struct dynlink *dyn)
+static void *_find_my_handle(lua_State *L)
 {
     const char *libname = luaL_checkstring(L, 1), *s;
+    void *self_handle = NULL;
 
     lua_pushnil(L);
     while (lua_next(L, LUA_REGISTRYINDEX)) {
@@ -1034,7 +1267,7 @@ static int _find_my_handle(lua_State *L, struct dynlink *dyn)
 	    if (strstr(s, libname)) {
 		void **handle = (void**) lua_touserdata(L, -1);
 		if (handle)
-		    dyn->dl_self_handle = *handle;
+		    self_handle = *handle;
 		lua_pop(L, 2);
 		break;
 	    }
@@ -1042,23 +1275,18 @@ static int _find_my_handle(lua_State *L, struct dynlink *dyn)
 	lua_pop(L, 1);
     }
 
-    return 0;
+    return self_handle;
 }
 
 /**
- * Load the dynamic libraries.  Returns 0 on error.
- *
- * On Linux with automatic linking, nothing has to be done; the dynamic linker
- * already has loaded libgtk+2.0 and its dependencies.
+ * Load the dynamic libraries and resolve the symbols; dyn->dl_self_handle
+ * must already be set.  Doesn't use the Lua API, so that it can be called
+ * while holding a lock.
  *
  * Note: do _not_ use any functions that are runtime linked, e.g. g_malloc.
- *
- * @param module_name  Name of the module that is being loaded (from require)
  */
-int lg_dl_init(lua_State *L, struct dynlink *dyn)
+static void _dl_load(struct dynlink *dyn)
 {
-    _find_my_handle(L, dyn);
-
     if (dyn->dll_list) {
 	const char *dlname;
 	int cnt;
@@ -1103,7 +1331,21 @@ int lg_dl_init(lua_State *L, struct dynlink *dyn)
 	    }
 	}
     }
+}
+
 
+/**
+ * Load the dynamic libraries.  Returns 0 on error.
+ *
+ * On Linux with automatic linking, nothing has to be done; the dynamic linker
+ * already has loaded libgtk+2.0 and its dependencies.
+ *
+ * @param module_name  Name of the module that is being loaded (from require)
+ */
+int lg_dl_init(lua_State *L, struct dynlink *dyn)
+{
+    dyn->dl_self_handle = _find_my_handle(L);
+    _dl_load(dyn);
     return 1;
 }
 
@@ -1149,6 +1391,7 @@ int lg_find_func(lua_State *L, cmi mi, const char *func_name,
 	fi->name = func_name;
 	fi->args_len = datalen;
 	fi->module_idx = mi->module_idx;
+	fi->plan = NULL;
 	return 1;
     }
 
@@ -688,6 +688,7 @@ static const struct _debug_flags {
     { "valgrind", 1, RUNTIME_VALGRIND },
     { "closure", 0, RUNTIME_DEBUG_CLOSURES },
     { "profile", 0, RUNTIME_PROFILE },
+    { "nofastcall", 0, RUNTIME_NO_FAST_CALLS },
     { NULL, 0 }
 };
 
@@ -776,6 +777,10 @@ static int _set_debug_flags(lua_State *L, int new_flags)
  *   memory    Show memory debuggin info (new objects, garbage collection)
  *   gmem      At exit, show the GMem profile
  *   valgrind  Do something to make valgrind run better (see source)
+ *   profile   Collect call counts and times of library functions and
+ *		 callbacks, see get_profile; shown at program exit
+ *   nofastcall  Call all library functions through libffi, even those
+ *		 with a signature that has a direct call stub (see call.c)
  *
  * @name set_debug_flags
  * @luaparam flags...  Debugging flags (zero or more may be given)
@@ -6,9 +6,12 @@
  * Exported symbols:
  *   lg_push_constant
  *   lg_get_constant
+ *   lg_enum_is_integer
+ *   lg_init_enum
  */
 
 #include "luagnome.h"
+#include <string.h>	    // memset
 
 // current max length of a type name is 45, plus "const " and ***
 #define TYPE_NAME_VAR(varname, ts) char varname[LG_TYPE_NAME_LENGTH]; \
@@ -141,7 +144,7 @@ static int enum_add_sub(lua_State *L, int mode)
 
     // the result is an enum of this type
     v1 = (mode == 0) ? v1 | v2 : v1 & ~v2;
-    lg_push_constant(L, e1 ? e1->ts : e2->ts, v1);
+    _push_enum(L, e1 ? e1->ts : e2->ts, v1);
     return 1;
 }
 
@@ -217,31 +220,157 @@ static const luaL_reg enum_methods[] = {
 };
 
 
+/* GType of an ENUM or FLAGS type, and which of the two it is. */
+struct enum_type {
+    GType gtype;
+    unsigned int flag : 2;	/* as ts.flag in struct lg_enum_t */
+    unsigned int valid : 1;	/* set when determined */
+};
+
+/* For each module_idx, an array of enum_type indexed by type_idx.  Shared
+ * by all Lua states and protected by enum_types_lock. */
+static struct enum_type **enum_types = NULL;
+static int enum_types_alloc = 0;
+static volatile int enum_types_lock = 0;
+
+/* ENUMs in use are interned, so that pushing the same value again doesn't
+ * create a new userdata.  The registry has a table at this key (the address is
+ * used) that maps the typespec to a table with weak values, which maps the
+ * value to the userdata. */
+static const char _enum_cache_key = 0;
+
+/* How ENUMs are given to Lua, see set_enum_mode. */
+#define ENUM_MODE_DEFAULT 0	/* modules only: use the global mode */
+#define ENUM_MODE_TYPED 1	/* userdata with the type, see lg_enum_t */
+#define ENUM_MODE_INTEGER 2	/* plain integers */
+
+/* The mode for each module_idx (which has 8 bits), and the global mode in
+ * [0].  Like the debug flags, this applies to all Lua states. */
+static unsigned char enum_mode[256];
+
+/* The ENUM returned by lg_get_constant for an integer; per thread */
+static LG_THREAD_LOCAL struct lg_enum_t int_enum;
+
+
 /**
- * Create a userdata representing an ENUM value
- *
- * @return 1
+ * Should ENUMs of this type be plain integers?
  */
-int lg_push_constant(lua_State *L, typespec_t ts, int value)
+static inline int _integer_mode(typespec_t ts)
 {
-    if (!ts.value)
-	return luaL_error(L, "%s lg_push_constant called with unset type",
-	    msgprefix);
-    struct lg_enum_t *e = (struct lg_enum_t*) lua_newuserdata(L,
-	sizeof(*e));
-    e->value = value;
-    e->ts = ts;
+    int mode = enum_mode[ts.module_idx];
+    return (mode ? mode : enum_mode[0]) == ENUM_MODE_INTEGER;
+}
+
+int lg_enum_is_integer(typespec_t ts)
+{
+    return _integer_mode(ts);
+}
+
 
-    // determine the GType - not all enums are registered with the GType
-    // system, especially Cairo ENUMs are not.
-    const char *name = lg_get_type_name(ts);
-    e->gtype = lg_gtype_from_name(L, modules[ts.module_idx], name);
-    if (G_TYPE_IS_ENUM(e->gtype))
-	e->ts.flag = 1;
-    else if (G_TYPE_IS_FLAGS(e->gtype))
-	e->ts.flag = 2;
+/**
+ * Determine the GType of an ENUM or FLAGS type.  Not all enums are registered
+ * with the GType system, especially Cairo ENUMs are not; their gtype is 0.
+ * This is done once for each type.
+ */
+static void _get_enum_type(lua_State *L, typespec_t ts, struct enum_type *et)
+{
+    struct enum_type *row;
+
+    LG_LOCK(enum_types_lock);
+    if (G_LIKELY(ts.module_idx < enum_types_alloc)) {
+	row = enum_types[ts.module_idx];
+	if (G_LIKELY(row && row[ts.type_idx].valid)) {
+	    *et = row[ts.type_idx];
+	    LG_UNLOCK(enum_types_lock);
+	    return;
+	}
+    }
+    LG_UNLOCK(enum_types_lock);
+
+    // might call the _get_type function; this must be done without the lock
+    et->gtype = lg_gtype_from_name(L, modules[ts.module_idx],
+	lg_get_type_name(ts));
+    if (G_TYPE_IS_ENUM(et->gtype))
+	et->flag = 1;
+    else if (G_TYPE_IS_FLAGS(et->gtype))
+	et->flag = 2;
     else
-	e->ts.flag = 0;
+	et->flag = 0;
+    et->valid = 1;
+
+    LG_LOCK(enum_types_lock);
+    if (ts.module_idx >= enum_types_alloc) {
+	enum_types = (struct enum_type**) g_realloc(enum_types,
+	    sizeof(*enum_types) * (module_count + 1));
+	memset(enum_types + enum_types_alloc, 0, sizeof(*enum_types)
+	    * (module_count + 1 - enum_types_alloc));
+	enum_types_alloc = module_count + 1;
+    }
+    row = enum_types[ts.module_idx];
+    if (!row)
+	row = enum_types[ts.module_idx] = (struct enum_type*) g_malloc0(
+	    sizeof(*row) * (modules[ts.module_idx]->type_count + 1));
+    row[ts.type_idx] = *et;
+    LG_UNLOCK(enum_types_lock);
+}
+
+
+/**
+ * Get the table of interned ENUMs of the given type, creating it if required.
+ */
+static void _get_enum_cache(lua_State *L, typespec_t ts)
+{
+    lua_pushlightuserdata(L, (void*) &_enum_cache_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    if (G_UNLIKELY(lua_isnil(L, -1))) {
+	lua_pop(L, 1);
+	lua_newtable(L);
+	lua_pushlightuserdata(L, (void*) &_enum_cache_key);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+    }
+
+    lua_pushnumber(L, ts.value);
+    lua_rawget(L, -2);				// types cache|nil
+    if (G_UNLIKELY(lua_isnil(L, -1))) {
+	lua_pop(L, 1);
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushliteral(L, "v");
+	lua_setfield(L, -2, "__mode");
+	lua_setmetatable(L, -2);
+	lua_pushnumber(L, ts.value);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, -4);			// types cache
+    }
+    lua_remove(L, -2);				// cache
+}
+
+/**
+ * Create a userdata representing an ENUM value.  ENUMs are immutable, so
+ * the userdata of the same type and value is reused while it exists.
+ */
+static void _push_enum(lua_State *L, typespec_t ts, int value)
+{
+    struct enum_type et;
+    struct lg_enum_t *e;
+
+    _get_enum_type(L, ts, &et);
+    ts.flag = et.flag;
+
+    _get_enum_cache(L, ts);
+    lua_pushnumber(L, value);
+    lua_rawget(L, -2);				// cache ud/nil
+    if (G_LIKELY(!lua_isnil(L, -1))) {
+	lua_remove(L, -2);
+	return;
+    }
+    lua_pop(L, 1);				// cache
+
+    e = (struct lg_enum_t*) lua_newuserdata(L, sizeof(*e));
+    e->value = value;
+    e->ts = ts;
+    e->gtype = et.gtype;
 
     // add a metatable with some methods
     if (luaL_newmetatable(L, ENUM_META)) {
@@ -252,18 +381,56 @@ int lg_push_constant(lua_State *L, typespec_t ts, int value)
     }
 
     lua_setmetatable(L, -2);
+
+    // remember in the cache
+    lua_pushnumber(L, value);
+    lua_pushvalue(L, -2);			// cache ud value ud
+    lua_rawset(L, -4);				// cache ud
+    lua_remove(L, -2);				// ud
+}
+
+
+/**
+ * Push an ENUM value: a userdata, or an integer if the integer mode is
+ * selected for its type.
+ *
+ * @return 1
+ */
+int lg_push_constant(lua_State *L, typespec_t ts, int value)
+{
+    if (!ts.value)
+	return luaL_error(L, "%s lg_push_constant called with unset type",
+	    msgprefix);
+
+    if (_integer_mode(ts))
+	lua_pushinteger(L, value);
+    else
+	_push_enum(L, ts, value);
     return 1;
 }
 
 
 /**
  * Retrieve the value of an enum on the Lua stack.  Optionally check the
- * enum type.
+ * enum type.  If the integer mode is selected for the type, a number is
+ * accepted too; the result then is only valid until the next call.
  */
 struct lg_enum_t *lg_get_constant(lua_State *L, int index,
     typespec_t ts, int raise_error)
 {
-    struct lg_enum_t *e = (struct lg_enum_t*) lua_touserdata(L, index);
+    struct lg_enum_t *e;
+
+    if (ts.value && lua_type(L, index) == LUA_TNUMBER && _integer_mode(ts)) {
+	struct enum_type et;
+	_get_enum_type(L, ts, &et);
+	int_enum.value = lua_tointeger(L, index);
+	int_enum.gtype = et.gtype;
+	int_enum.ts = ts;
+	int_enum.ts.flag = et.flag;
+	return &int_enum;
+    }
+
+    e = (struct lg_enum_t*) lua_touserdata(L, index);
 
     if (!e) {
 	if (raise_error)
@@ -301,5 +468,56 @@ struct lg_enum_t *lg_get_constant(lua_State *L, int index,
 
     return e;
 }
-    
+
+
+/**
+ * Select how ENUM and FLAGS values are given to Lua: as userdata that know
+ * their type, which is the default, or as plain integers.  The latter
+ * avoids creating a userdata for each value returned by a function, read
+ * from a structure or a GValue; numbers are then accepted wherever such an
+ * ENUM is expected.  Typed ENUMs can still be used as arguments.
+ *
+ * @name set_enum_mode
+ * @luaparam mode  "typed" or "integer"; "default" to use the global mode
+ *   for the given module.
+ * @luaparam module  (optional) Name of a module, e.g. "gtk", to select the
+ *   mode just for the ENUMs defined there.  Without it, the global mode
+ *   is set.
+ * @luareturn  The previous mode.
+ */
+static int l_set_enum_mode(lua_State *L)
+{
+    static const char *const modes[] = { "default", "typed", "integer",
+	NULL };
+    int mode = luaL_checkoption(L, 1, NULL, modes), idx = 0, old;
+    const char *name = luaL_optstring(L, 2, NULL);
+
+    if (name) {
+	struct module_info *mi = lg_find_module(name);
+	if (!mi)
+	    return luaL_error(L, "%s set_enum_mode: module %s not loaded",
+		msgprefix, name);
+	idx = mi->module_idx;
+    } else if (mode == ENUM_MODE_DEFAULT)
+	return luaL_argerror(L, 1, "global mode can't be \"default\"");
+
+    old = enum_mode[idx];
+    if (!old && !idx)
+	old = ENUM_MODE_TYPED;
+    enum_mode[idx] = mode;
+    lua_pushstring(L, modes[old]);
+    return 1;
+}
+
+
+static const luaL_reg enum_gnome_methods[] = {
+    {"set_enum_mode",	l_set_enum_mode },
+    { NULL, NULL }
+};
+
+/* Register the ENUM functions in the gnome table */
+void lg_init_enum(lua_State *L)
+{
+    luaL_register(L, NULL, enum_gnome_methods);
+}
 
@@ -320,8 +320,7 @@ void lg_lua_to_gvalue_cast(lua_State *L, int index, GValue *gv, GType gtype)
 		    break;
 
 		case LUA_TUSERDATA:;
-		    const char *name = g_type_name(gv->g_type);
-		    ts = lg_find_struct(L, name, 0);
+		    ts = lg_find_struct_gtype(L, gv->g_type, 0);
 		    struct lg_enum_t *e = lg_get_constant(L, index, ts, 1);
 		    gv->data[0].v_int = e->value;
 		    break;
@@ -567,7 +566,7 @@ static void _push_gvalue_fundamental(lua_State *L, GValue *gv)
 	case G_TYPE_ENUM:
 	case G_TYPE_FLAGS:;
 	    if (G_TYPE_IS_DERIVED(type)) {
-		typespec_t ts = lg_find_struct(L, g_type_name(type), 0);
+		typespec_t ts = lg_find_struct_gtype(L, type, 0);
 		if (ts.value) {
 		    lg_push_constant(L, ts, gv->data[0].v_int);
 		    return;
@@ -607,6 +606,68 @@ static void _push_gvalue_fundamental(lua_State *L, GValue *gv)
 
 
 
+/*-
+ * For non-fundamental GTypes, lg_gvalue_to_lua remembers what it found out
+ * about them: the typespec of a boxed type, or that it is derived from
+ * GObject.  This is a direct mapped cache per thread, so no locking is
+ * required; the results don't depend on the Lua state.
+ */
+#define GVALUE_CACHE_SIZE 64	    /* must be a power of two */
+#define GVALUE_OBJECT 1		    /* marker: derived from GObject; this is
+				       no valid typespec (module_idx 0) */
+
+struct gvalue_cache_entry {
+    GType gtype;
+    typespec_t ts;
+};
+
+static LG_THREAD_LOCAL struct gvalue_cache_entry
+    gvalue_cache[GVALUE_CACHE_SIZE];
+
+
+/**
+ * Determine how to push a GValue of a non-fundamental type.
+ *
+ * @return  GVALUE_OBJECT for GObjects, else the typespec of the boxed type,
+ *   which is zero if not found.
+ */
+static typespec_t _gvalue_type(lua_State *L, GType gtype)
+{
+    struct gvalue_cache_entry *e = gvalue_cache
+	+ ((gtype >> 2) & (GVALUE_CACHE_SIZE - 1));
+    typespec_t ts = { 0 };
+    const char *name;
+
+    if (G_LIKELY(e->gtype == gtype))
+	return e->ts;
+
+    name = g_type_name(gtype);
+    if (!name)
+	luaL_error(L, "%s callback argument GType %d invalid", msgprefix,
+	    gtype);
+
+    /* If this type is actually derived from GObject, then let make_object
+     * find out the exact type itself.  Maybe it is a type derived from the
+     * one specified, then better use that.
+     */
+    if (g_type_is_a(gtype, G_TYPE_OBJECT))
+	ts.value = GVALUE_OBJECT;
+    else {
+	ts = lg_find_struct_gtype(L, gtype, 1);
+	if (!ts.value) {
+	    // not remembered; the module defining it might be loaded later.
+	    printf("%s structure not found for callback arg: %s\n",
+		msgprefix, name);
+	    return ts;
+	}
+    }
+
+    e->gtype = gtype;
+    e->ts = ts;
+    return ts;
+}
+
+
 /**
  * A parameter for a callback must be pushed onto the stack, or a return
  * value from Gtk converted to a Lua type.  A value is always pushed; in the
@@ -643,33 +704,17 @@ void lg_gvalue_to_lua(lua_State *L, GValue *gv)
 	return;
     }
 
-
     /* not a fundamental type */
-    const char *name = g_type_name(gtype);
-    if (!name)
-	luaL_error(L, "%s callback argument GType %d invalid", msgprefix,
-	    gtype);
-
-    /* If this type is actually derived from GObject, then let make_object
-     * find out the exact type itself.  Maybe it is a type derived from the
-     * one specified, then better use that.
-     */
-    int type_of_gobject = g_type_from_name("GObject");
-    typespec_t ts = { 0 };
-    if (g_type_is_a(gtype, type_of_gobject)) {
-	// pushes nil on error.
-	lg_get_object(L, * (void**) data, ts, FLAG_NOT_NEW_OBJECT);
-	return;
-    }
-    
-    ts = lg_find_struct(L, name, 1);
+    typespec_t ts = _gvalue_type(L, gtype);
     if (!ts.value) {
-	printf("%s structure not found for callback arg: %s\n",
-	    msgprefix, name);
 	lua_pushnil(L);
 	return;
     }
 
+    // for GObjects, lg_get_object determines the type; pushes nil on error.
+    if (ts.value == GVALUE_OBJECT)
+	ts.value = 0;
+
     /* Find or create a Lua wrapper for the given object. */
     lg_get_object(L, * (void**) data, ts, FLAG_NOT_NEW_OBJECT);
 }
@@ -302,6 +302,33 @@ static void *default_allocate_object(cmi mi, lua_State *L, typespec_t ts,
 }
 
 
+/*-
+ * Small structures without pointers to memory they own, which are often
+ * allocated in loops.  gnome.new stores them in the proxy object, see
+ * lg_new_value_object.  They must not be freed explicitly, e.g. with
+ * gtk_tree_iter_free.
+ */
+static const char *const value_types[] = {
+    "GtkTreeIter",
+    "GtkTextIter",
+    "GdkRectangle",
+    "GdkColor",
+    "GdkPoint",
+    NULL
+};
+
+static int _is_value_type(typespec_t ts)
+{
+    const char *type_name = lg_get_type_name(ts);
+    const char *const *p;
+
+    for (p=value_types; *p; p++)
+	if (!strcmp(type_name, *p))
+	    return 1;
+    return 0;
+}
+
+
 /**
  * Allocate a structure, initialize with zero and return it.
  *
@@ -310,7 +337,8 @@ static void *default_allocate_object(cmi mi, lua_State *L, typespec_t ts,
  * structures like GtkTreeIter.
  *
  * The object is, as usual, a Lua wrapper in the form of a userdata,
- * containing a pointer to the actual object.
+ * containing a pointer to the actual object.  For the small structures
+ * listed in value_types, the userdata contains the structure itself.
  *
  * @param L  Lua State
  * @param mi  Module that handles the type
@@ -374,6 +402,11 @@ static int lg_generic_new_array(lua_State *L, cmi mi, int is_array)
     /* no additional arguments must be given - they won't be used. */
     luaL_checktype(L, 3, LUA_TNONE);
 
+    if (count == 0 && _is_value_type(ts)) {
+	lg_new_value_object(L, ts);
+	return 1;
+    }
+
     if (mi->allocate_object)
 	p = mi->allocate_object(mi, L, ts, count, &flags);
     else
@@ -382,8 +415,8 @@ static int lg_generic_new_array(lua_State *L, cmi mi, int is_array)
     /* Allocate and initialize the object.  I used to allocate just one
      * userdata big enough for both the wrapper and the object, but many free
      * functions exist, like gtk_tree_iter_free, and they expect a memory block
-     * allocated by g_slice_alloc0.  Therefore this optimization is not
-     * possible. */
+     * allocated by g_slice_alloc0.  Therefore this optimization is only
+     * done for the value_types above. */
 
     /* Make a Lua wrapper for it, push it on the stack.  FLAG_ALLOCATED causes
      * the _malloc_handler be used, and FLAG_NEW_OBJECT makes it not complain
@@ -515,6 +548,8 @@ static const luaL_reg gnome_methods[] = {
     {"get_vwrapper_count", lg_get_vwrapper_count },
     {"destroy",		lg_destroy },
     {"cast",		lg_cast },
+    {"batch",		lg_call_batch },
+    {"get_arena_stats",	lg_call_arena_stats },
     { NULL, NULL }
 };
 
@@ -569,7 +604,7 @@ static struct dynlink gnome_dynlink = {
 };
 
 
-extern struct call_info *ci_current;
+extern LG_THREAD_LOCAL struct call_info *ci_current;
 static void lg_log_func(const gchar *domain, GLogLevelFlags log_level,
     const gchar *message, gpointer user_data)
 {
@@ -590,20 +625,31 @@ static void lg_log_func(const gchar *domain, GLogLevelFlags log_level,
  */
 int luaopen_gnome(lua_State *L)
 {
-    // get this module's name, then discard the argument.
-    lib_name = strdup(lua_tostring(L, 1));
-    lg_dl_init(L, &gnome_dynlink);
+    static volatile int lock = 0;
+
+    // Process wide initialization, once for all Lua states: get this
+    // module's name, load the libraries.
+    LG_LOCK(lock);
+    if (!lib_name) {
+	lib_name = strdup(lua_tostring(L, 1));
+	lg_dl_init(L, &gnome_dynlink);
+	g_type_init();
+    }
+    LG_UNLOCK(lock);
+
+    // discard the argument
     lua_settop(L, 0);
     lg_debug_flags_global(L);
 
-    g_type_init();
-
     /* make the table to return, and make it global as "gnome" */
     luaL_register(L, lib_name, gnome_methods);
     _init_module_info(L);
     lg_init_object(L);
     lg_init_debug(L);
+    lg_init_profile(L);
+    lg_init_enum(L);
     lg_init_boxed(L);
+    lg_init_array(L);
     lg_init_closure(L);
 
     // an object that can be used as NIL
@@ -611,42 +657,24 @@ int luaopen_gnome(lua_State *L)
     lua_pushlightuserdata(L, NULL);
     lua_rawset(L, -3);
 
-    // a metatable to make another table have weak values
-    lua_newtable(L);			// gnome mt
-    lua_pushliteral(L, "v");		// gnome mt "v"
-    lua_setfield(L, -2, "__mode");	// gnome mt
-
     // Table with all object metatables; [name] = table.  When no objects
     // of the given type exist anymore, they may be removed if weak values
     // are used; this doesn't make much sense, as a program will most likely
     // use a certain object type again if it is used once.
-    lua_newtable(L);			// gnome mt t
-    lua_setfield(L, 1, LUAGNOME_METATABLES);	// gnome mt
-    
-    // objects: not a weak table.  It only contains references to entries
-    // in the aliases table; they are removed manually when the last alias
-    // is garbage collected.
-    lua_newtable(L);			    // gnome mt t
-    lua_setfield(L, 1, LUAGNOME_WIDGETS);    // gnome mt
-
-    // gnome.aliases.  It has automatic garbage collection (weak values).
-    lua_newtable(L);
-    lua_pushvalue(L, -2);
-    lua_setmetatable(L, -2);
-    lua_setfield(L, 1, LUAGNOME_ALIASES);    // gnome mt
+    lua_newtable(L);			// gnome t
+    lua_setfield(L, 1, LUAGNOME_METATABLES);	// gnome
 
-    // gnome.typemap is a table that maps hash values of native types to
-    // their typespec_t.  It is required in lg_type_normalize.
-    lua_newtable(L);
-    lua_setfield(L, 1, "typemap");
+    // map of object addresses to proxy objects, see object_map.c.  The
+    // weak table of proxy objects is available as gnome.aliases for
+    // debugging.
+    lg_init_object_map(L);
+    lg_object_map_aliases(L);
+    lua_setfield(L, 1, "aliases");
 
     // gnome.fundamental_map is a table that maps hash values of fundamental
     // types to their index in ffi_type_map.
     lg_create_fundamental_map(L);
 
-    lua_pop(L, 1);			    // gnome
-
-
     /* default attribute table of an object */
     lua_newtable(L);			    // gnome t
     lua_setfield(L, 1, LUAGNOME_EMPTYATTR);
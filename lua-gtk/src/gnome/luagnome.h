@@ -26,10 +26,17 @@
 extern char *lib_name;
 #define LUAGNOME_TBL		lib_name
 #define LUAGNOME_METATABLES	"metatables"
-#define LUAGNOME_WIDGETS	"objects"
-#define LUAGNOME_ALIASES	"aliases"
 #define LUAGNOME_EMPTYATTR	"emptyattr"
 
+// Several Lua states, each in its own thread, may use this library at the
+// same time.  State of the call machinery is kept per thread, while the few
+// tables shared by all threads are protected by a spinlock; those are only
+// held for short lookups and never across calls into Lua or the libraries.
+#define LG_THREAD_LOCAL __thread
+#define LG_LOCK(l) do { while (!__sync_bool_compare_and_swap(&(l), 0, 1)) \
+    ; } while (0)
+#define LG_UNLOCK(l) __sync_lock_release(&(l))
+
 // Access to type and structure element names
 #define FTYPE_NAME(t) (gnome_ffi_type_names + (t)->name_ofs)
 
@@ -143,6 +150,8 @@ int lg_vwrapper_get(lua_State *L, struct value_wrapper *wrp);
 int lg_push_constant(lua_State *L, typespec_t ts, int value);
 struct lg_enum_t *lg_get_constant(lua_State *L, int index, typespec_t ts,
     int raise_error);
+int lg_enum_is_integer(typespec_t ts);
+void lg_init_enum(lua_State *L);
 
 /*-
  * entry (type "userdata") in the meta table of a object.  These entries are
@@ -152,8 +161,8 @@ struct lg_enum_t *lg_get_constant(lua_State *L, int index, typespec_t ts,
 struct meta_entry {
     typespec_t ts;			/* 0=function */
     union {
-	struct func_info fi;		/* 16 bytes */
-	const struct struct_elem *se;   /* 4 bytes */
+	struct func_info fi;		/* for functions */
+	const struct struct_elem *se;   /* for attributes */
     };
     typespec_t iface_ts;		/* see below */
     GType iface_type_id;		/* GType of the interface */
@@ -169,12 +178,13 @@ struct meta_entry {
  * Objects are represented in Lua by this userdata.  It also has a metatable
  * that contains more information, see gtk2.c:get_object_meta.
  *
- * The table "gnome.objects" maps the object address to a reference in a second
- * table, aliases. These aliases can form a singly linked circular list.
- * Entries in the object table are not weak; entries in the aliases table are.
- * Garbage collection of aliases works like this:
+ * The object map (see object_map.c) maps the object address to one of the
+ * proxy objects, and the table "aliases" maps that to the userdata.  These
+ * aliases can form a singly linked circular list.  Entries in the object map
+ * are not weak; entries in the aliases table are.  Garbage collection of
+ * aliases works like this:
  *
- *  - get the matching entry in "objects" using the "p" field (pointer)
+ *  - get the matching entry in the object map using the "p" field (pointer)
  *  - if "next" is not 0, follow until an alias is found whose "next" points
  *    to the current alias; set its "next" to this "next" or 0
  *  - if the "first" of the alias entry points here, set it to this "next";
@@ -228,10 +238,12 @@ struct call_info {
     void **argvalues;			    /* [0] not used */
     struct call_arg *args;
 
-    union {
-	struct call_info_list *first;	    /* allocated extra memory */
-	struct call_info *next;		    /* chain of free call_infos */
-    };
+    /* scratch memory for extra arguments, see call_info_alloc_item */
+    struct call_arena *arena;		    /* current block */
+    int arena_used;			    /* bytes used in it */
+
+    struct call_info *next;		    /* chain of free call_infos */
+    unsigned int serial;		    /* increased after each call */
 };
 
 // in data.c
@@ -249,6 +261,7 @@ int lg_find_func(lua_State *L, cmi mi, const char *func_name,
 int lg_find_global(lua_State *L, cmi mi, const char *name);
 typespec_t lg_find_struct(lua_State*, const char *type_name, int indir);
 typespec_t lg_get_type(lua_State *L, const char *type_name);
+typespec_t lg_find_struct_gtype(lua_State *L, GType type, int indirections);
 const struct struct_elem *find_attribute(typespec_t ts, const char *attr_name);
 int lg_find_constant(lua_State *L, typespec_t *ts, const char *key,
     int keylen, int *result);
@@ -280,6 +293,7 @@ extern int runtime_flags;
 void lg_get_object(lua_State *L, void *p, typespec_t ts, int flags);
 struct object *lg_check_object(lua_State *L, int index);
 void lg_invalidate_object(lua_State *L, struct object *w);
+struct object *lg_new_value_object(lua_State *L, typespec_t ts);
 
 // in object_types.c
 void lg_init_object(lua_State *L);
@@ -293,9 +307,22 @@ struct object_type *lg_get_object_type(lua_State *L, struct object *w);
 int lg_call_object_handler(struct object *w, object_op op, int flags,
     const char *name);
 
+// in object_map.c
+struct object_map;
+void lg_init_object_map(lua_State *L);
+struct object_map *lg_object_map(lua_State *L);
+struct object_map *lg_object_map_aliases(lua_State *L);
+struct object *lg_object_map_lookup(struct object_map *map, const void *p);
+void lg_object_map_set(struct object_map *map, const void *p,
+    struct object *o);
+
 // in object_meta.c
+extern volatile int lg_method_cache_generation;
+void lg_method_cache_watch(lua_State *L, int is_module);
 int lg_object_index(lua_State *L);
 int lg_object_newindex(lua_State *L);
+int lg_object_get_fields(lua_State *L);
+int lg_object_set_fields(lua_State *L);
 
 
 // in init.c
@@ -304,6 +331,10 @@ int lg_push_closure(lua_State *L, const struct func_info *fi, int alloc_fi);
 // int lg_argerror(lua_State *L, int narg, const char *format, ...);
 struct func_info *lg_get_closure(lua_State *L, int index);
 
+// in array.c
+void *lg_array_view_ptr(lua_State *L, int index, int size, int is_float);
+void lg_init_array(lua_State *L);
+
 // in boxed.c
 extern int lg_boxed_value_type;
 void	lg_init_boxed(lua_State *L);
@@ -318,10 +349,12 @@ enum lg_msg_level { LUAGNOME_DEBUG=0, LUAGNOME_INFO, LUAGNOME_WARNING,
 int lg_call(lua_State *L, struct func_info *fi, int index);
 int lg_call_byname(lua_State *L, cmi mi, const char *func_name);
 int lg_call_function(lua_State *L, const char *mod_name, const char *func_name);
+int lg_call_batch(lua_State *L);
 void call_info_warn(struct call_info *ci);
 void call_info_msg(lua_State *L, struct call_info *ci, enum lg_msg_level level);
 struct call_info *call_info_alloc();
 void *call_info_alloc_item(struct call_info *ci, int size);
+int lg_call_arena_stats(lua_State *L);
 void call_info_check_argcount(struct call_info *ci, int n);
 void call_info_free(struct call_info *ci);
 void call_info_free_pool();
@@ -331,11 +364,20 @@ inline void get_next_argument(lua_State *L, const unsigned char **p,
 // closure.c
 void lg_init_closure(lua_State *L);
 void lg_done_closure();
-int lg_create_closure(lua_State *L, int index, int is_automatic);
+int lg_create_closure(lua_State *L, int index, struct call_info *ci);
 void *lg_use_closure(lua_State *L, int index, typespec_t ts,
     int arg_nr, const char *func_name);
 int lg_use_c_closure(struct argconv_t *ar);
 
+// profile.c
+struct lg_profile;
+gint64 lg_profile_time();
+struct lg_profile *lg_profile_get(const void *key, const char *name,
+    int is_callback);
+void lg_profile_add(struct lg_profile *p, gint64 t_start, gint64 t_call,
+    gint64 t_return, gint64 t_end);
+void lg_init_profile(lua_State *L);
+
 // gvalue.c
 void lg_lua_to_gvalue_cast(lua_State *L, int index, GValue *gv, GType gtype);
 GValue *lg_lua_to_gvalue(lua_State *L, int index, GValue *gvalue);
@@ -8,6 +8,7 @@
  *   lg_get_object
  *   lg_check_object
  *   lg_invalidate_object
+ *   lg_new_value_object
  */
 
 #include "luagnome.h"
@@ -17,6 +18,15 @@ static struct object *_make_object(lua_State *L, void *p, typespec_t ts,
     int flags);
 static int _get_object_meta(lua_State *L, typespec_t ts);
 
+/* Registry refs of the metatables of this Lua state, see _meta_ref_slot. */
+struct meta_refs {
+    int module_alloc;		/* length of refs */
+    int **refs;			/* [module_idx][type_idx]; 0 = not created */
+};
+
+/* key of struct meta_refs in the registry; the address is used. */
+static const char _meta_refs_key = 0;
+
 /**
  * The Lua stack should contain a proxy object at the given stack position,
  * verify this.
@@ -57,8 +67,8 @@ struct object *lg_check_object(lua_State *L, int index)
 }
 
 /**
- * Update/remove the entry in objects, which maps the library object's address
- * to the address of one of the aliases.
+ * Update/remove the entry in the object map, which maps the library object's
+ * address to the address of one of the aliases.
  *
  * @param L  Lua State
  * @param p  Pointer to the object
@@ -68,33 +78,13 @@ struct object *lg_check_object(lua_State *L, int index)
 static void _set_object_pointer(lua_State *L, void *p, struct object *o,
     struct object *old_o)
 {
-    lua_getglobal(L, LUAGNOME_TBL);
-    lua_getfield(L, -1, LUAGNOME_WIDGETS);	// gnome objects
-
-    // Check that the entry in objects currently points to old_o.  If not,
-    // don't update.
-    if (old_o) {
-	lua_pushlightuserdata(L, p);
-	lua_rawget(L, -2);
-	if (lua_topointer(L, -1) != old_o) {
-	    /*
-	    fprintf(stderr, "NOT setting object[%p] = %d (%d != %d)\n", p, ref,
-		lua_tointeger(L, -1), old_ref);
-	    */
-	    lua_pop(L, 3);
-	    return;
-	}
-	lua_pop(L, 1);
-    }
+    struct object_map *map = lg_object_map(L);
 
-    lua_pushlightuserdata(L, p);	    // gnome objects *p
-    if (o)
-	lua_pushlightuserdata(L, o);	    // gnome objects *p *o
-    else
-	lua_pushnil(L);
+    // Check that the entry currently points to old_o.  If not, don't update.
+    if (old_o && lg_object_map_lookup(map, p) != old_o)
+	return;
 
-    lua_rawset(L, -3);
-    lua_pop(L, 2);
+    lg_object_map_set(map, p, o);
 }
 
 
@@ -103,23 +93,11 @@ static void _set_object_pointer(lua_State *L, void *p, struct object *o,
  *
  * @param L  Lua State
  * @param p  Pointer to the object to find an alias for.
- * @return  the address, or -1 if not found.
+ * @return  the address, or NULL if not found.
  */
 static struct object *_get_object_ref(lua_State *L, void *p)
 {
-    struct object *o = NULL;
-    // int ref_nr = -1;
-
-    lua_getglobal(L, LUAGNOME_TBL);		// gnome
-    lua_getfield(L, -1, LUAGNOME_WIDGETS);	// gnome objects
-    lua_pushlightuserdata(L, p);		// gnome objects p
-    lua_rawget(L, -2);				// gnome objects *o
-    if (!lua_isnil(L, -1))
-	o = (struct object*) lua_topointer(L, -1);
-	// ref_nr = lua_tonumber(L, -1);
-    lua_pop(L, 3);				// stack empty again
-
-    return o; // ref_nr;
+    return lg_object_map_lookup(lg_object_map(L), p);
 }
 
 
@@ -141,7 +119,7 @@ static void _alias_unlink(lua_State *L, struct object *o)
 	/* empty */ ;
     o2->next = (o->next == o2) ? NULL : o->next;
 
-    /* If the entry in objects points to "o", change it to o2 */
+    /* If the entry in the object map points to "o", change it to o2 */
     o3 = _get_object_ref(L, o2->p);
     if (o3 == o)
 	_set_object_pointer(L, o2->p, o2, 0);
@@ -223,7 +201,7 @@ static int lg_object_gc(struct lua_State *L)
     }
 
     // If other aliases exist, remove this one from the linked list; otherwise,
-    // unset the entry in gtk.objects.
+    // unset the entry in the object map.
     if (w->next)
 	_alias_unlink(L, w);
 
@@ -240,11 +218,11 @@ static int lg_object_gc(struct lua_State *L)
 /**
  * A object has been freed and must not be accessed anymore.  Invalidate the
  * object proxy and all aliases.
- * It should have an entry in objects, which will be removed too.
+ * It should have an entry in the object map, which will be removed too.
  *
  * XXX seems not to be correct.  if multiple aliases exist, remove just this
- * from the circular list and set the pointer in "objects" to one of the
- * others.
+ * from the circular list and set the pointer in the object map to one of
+ * the others.
  */
 void lg_invalidate_object(lua_State *L, struct object *o)
 {
@@ -307,7 +285,7 @@ static int _get_object_meta_parent(lua_State *L, GType type_nr)
      * not known to LuaGnome.  Also, when a base class should be handled by
      * another module, which doesn't have it or isn't loaded, this fails
      * in the same way. */
-    ts = lg_find_struct(L, parent_name, 0);
+    ts = lg_find_struct_gtype(L, parent_type_nr, 0);
 
     if (!ts.value) {
 	/* Might be a non-native type of this module; it could be looked
@@ -367,29 +345,107 @@ static const luaL_reg object_methods[] = {
     { "__gc",	    lg_object_gc },
     { "__eq",	    l_object_compare },
     { "lg_get_type",l_object_get_type },
+    { "get_fields", lg_object_get_fields },
+    { "set_fields", lg_object_set_fields },
     { NULL, NULL }
 };
 
+/**
+ * The Lua state is being closed; free the arrays of metatable refs.
+ */
+static int _meta_refs_gc(lua_State *L)
+{
+    struct meta_refs *mr = (struct meta_refs*) lua_touserdata(L, 1);
+    int i;
+
+    for (i=0; i<mr->module_alloc; i++)
+	g_free(mr->refs[i]);
+    g_free(mr->refs);
+    mr->refs = NULL;
+    mr->module_alloc = 0;
+    return 0;
+}
+
+
+/**
+ * Find the slot for the registry ref of the metatable of the given type.
+ * Each Lua state has a userdata in the registry with an array of refs for
+ * each module, indexed by type_idx, which starts at 1; these are allocated
+ * on first use, and grown when further modules are loaded.
+ *
+ * @param L  Lua State
+ * @param ts  Type of the object; must be valid
+ * @return  Pointer to the registry ref, which is 0 if not created yet.
+ */
+static int *_meta_ref_slot(lua_State *L, typespec_t ts)
+{
+    struct meta_refs *mr;
+
+    lua_pushlightuserdata(L, (void*) &_meta_refs_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    mr = (struct meta_refs*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (G_UNLIKELY(!mr)) {
+	lua_pushlightuserdata(L, (void*) &_meta_refs_key);
+	mr = (struct meta_refs*) lua_newuserdata(L, sizeof(*mr));
+	memset(mr, 0, sizeof(*mr));
+	lua_newtable(L);			// key mr mt
+	lua_pushcfunction(L, _meta_refs_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);		// key mr
+	lua_rawset(L, LUA_REGISTRYINDEX);
+    }
+
+    if (G_UNLIKELY(ts.module_idx >= mr->module_alloc)) {
+	int n = module_count + 1;
+	mr->refs = (int**) g_realloc(mr->refs, n * sizeof(*mr->refs));
+	memset(mr->refs + mr->module_alloc, 0,
+	    (n - mr->module_alloc) * sizeof(*mr->refs));
+	mr->module_alloc = n;
+    }
+
+    if (G_UNLIKELY(!mr->refs[ts.module_idx]))
+	mr->refs[ts.module_idx] = (int*) g_malloc0(
+	    (modules[ts.module_idx]->type_count + 1) * sizeof(int));
+
+    return mr->refs[ts.module_idx] + ts.type_idx;
+}
+
+
 /**
  * Given the type, retrieve or create the metaclass for this type of object.
  * If the given object type has a base class, recurse to make that, too.
  *
+ * The metatables are stored in gnome.metatables by name; for speed, a
+ * registry ref for each is kept in a C array, see _meta_ref_slot.
+ *
  * Stack input: nothing
  * Returns: 0 on error, or 1 on success.
  * Stack output: on success: the metaclass; otherwise, nothing.
  */
 static int _get_object_meta(lua_State *L, typespec_t ts)
 {
-    const char *type_name = lg_get_type_name(ts);
+    int *ref = _meta_ref_slot(L, ts);
+    const char *type_name;
+
+    if (G_LIKELY(*ref)) {
+	lua_rawgeti(L, LUA_REGISTRYINDEX, *ref);
+	return 1;
+    }
 
+    type_name = lg_get_type_name(ts);
     lua_getglobal(L, LUAGNOME_TBL);
     lua_getfield(L, -1, LUAGNOME_METATABLES);
     lua_remove(L, -2);				// _meta_tables
     lua_pushstring(L, type_name);		// _meta_tables name
     lua_rawget(L, -2);				// _meta_tables meta|nil
 
+    // another type with the same name may have created it already.
     if (!lua_isnil(L, -1)) {
 	lua_remove(L, -2);			// meta
+	lua_pushvalue(L, -1);			// meta meta
+	*ref = luaL_ref(L, LUA_REGISTRYINDEX);	// meta
 	return 1;
     }
     lua_pop(L, 1);				// _meta_tables
@@ -402,8 +458,11 @@ static int _get_object_meta(lua_State *L, typespec_t ts)
     lua_pushvalue(L, -2);			// _meta_tables t name t
     lua_rawset(L, -4);				// _meta_tables t
     lua_remove(L, -2);				// t
+    lua_pushvalue(L, -1);			// t t
+    *ref = luaL_ref(L, LUA_REGISTRYINDEX);	// t
 
     luaL_register(L, NULL, object_methods);
+    lg_method_cache_watch(L, 0);
 
     /* store the structure number and the class name */
     lua_pushliteral(L, "_typespec");
@@ -437,7 +496,7 @@ static int _get_object_meta(lua_State *L, typespec_t ts)
  *  2 ... type mismatch; need to create new Lua object
  *
  * Lua stack:
- *  [-3]=objects [-2]=aliases [-1]=w
+ *  [-2]=aliases [-1]=w
  *
  * w may be replaced with another object (alias), but otherwise the Lua stack
  * remains unchanged.
@@ -502,8 +561,8 @@ found:
     // the Lua stack, we need to use the mapping of address to it in the
     // table "aliases".  It is a weak table, so the entry might have
     // been removed before garbage collection.
-    lua_pushlightuserdata(L, w);	// objects aliases w *w2
-    lua_rawget(L, -3);			// objects aliases w w2
+    lua_pushlightuserdata(L, w);	// aliases w *w2
+    lua_rawget(L, -3);			// aliases w w2
 
     // If the entry in aliases has already been removed, stay with the
     // previously found alias and add a new alias there.
@@ -513,7 +572,7 @@ found:
     }
 
     // The entry in aliases still existed (usual case), so use the Lua object.
-    lua_remove(L, -2);			// objects aliases w2
+    lua_remove(L, -2);			// aliases w2
     return 0;
 }
 
@@ -546,7 +605,7 @@ static inline int _is_on_stack(void *p)
  * A object has been found for the given address.  It is on the Lua stack;
  * check that it matches the requested type.  If not, make a new alias.
  *
- * Lua stack: [-3]objects [-2]object_aliases [-1]w
+ * Lua stack: [-2]aliases [-1]w
  *
  * @param L  Lua State
  * @param p  Pointer to the object
@@ -569,7 +628,7 @@ static void _reuse_object(lua_State *L, void *p, typespec_t ts, int flags)
 	return;
     }
 	
-    // objects object_aliases w1 w2
+    // aliases w1 w2
     if (o2) {
 	// The old object, that already existed (with the wrong type)
 	struct object *w1 = (struct object*) lua_touserdata(L, -2);
@@ -587,7 +646,7 @@ static void _reuse_object(lua_State *L, void *p, typespec_t ts, int flags)
 		lg_get_object_name(w1));
     }
 
-    lua_remove(L, -2);				// objects aliases w2
+    lua_remove(L, -2);				// aliases w2
 }
 
 
@@ -628,38 +687,33 @@ void lg_get_object(lua_State *L, void *p, typespec_t ts, int flags)
 		"type %d.%d", msgprefix, ts.module_idx, ts.type_idx);
     }
 
-    // translate the address to a reference in the aliases table
-    lua_getglobal(L, LUAGNOME_TBL);
-    lua_getfield(L, -1, LUAGNOME_WIDGETS);
-    lua_getfield(L, -2, LUAGNOME_ALIASES);	// gnome objects aliases
-    lua_remove(L, -3);				// objects aliases
-
-    lua_pushlightuserdata(L, p);		// objects aliases *w
-    lua_rawget(L, -3);				// objects aliases *o/nil
+    // translate the address to a proxy object using the object map.
+    struct object_map *map = lg_object_map_aliases(L);	// aliases
+    struct object *o = lg_object_map_lookup(map, p);
 
     // If found, look up the address in aliases.  The address could be
     // used directly, but if the object is half garbage collected, the
     // entry might have been removed from the aliases table already.
-    if (!lua_isnil(L, -1)) {
-	lua_rawget(L, -2);			// objects aliases w/nil
+    if (o) {
+	lua_pushlightuserdata(L, o);		// aliases *o
+	lua_rawget(L, -2);			// aliases w/nil
 	if (!lua_isnil(L, -1)) {
 	    _reuse_object(L, p, ts, flags);
 	    goto ex;
 	}
+	lua_pop(L, 1);
     }
 
-    lua_pop(L, 1);
-
-    // Either the address isn't a key in gtk.objects, or the reference
-    // number isn't in gtk.object_aliases.  The latter may happen when an
-    // entry in object_aliases is removed by GC (weak values!), but
-    // lg_object_gc hasn't been called on it yet.
+    // Either the address isn't in the object map, or the proxy object
+    // isn't in aliases.  The latter may happen when an entry in aliases is
+    // removed by GC (weak values!), but lg_object_gc hasn't been called on
+    // it yet.
 
     // returns NULL if the object is on the stack.
-    struct object *o = _make_object(L, p, ts, flags);
+    o = _make_object(L, p, ts, flags);
     if (o && o != (void*) -1) {
-	// new entry in objects table
-	_set_object_pointer(L, p, o, NULL);
+	// new entry in the object map
+	lg_object_map_set(map, p, o);
 
 	if (G_UNLIKELY(runtime_flags & RUNTIME_DEBUG_MEMORY
 	    && !lua_isnil(L, -1))) {
@@ -672,7 +726,6 @@ void lg_get_object(lua_State *L, void *p, typespec_t ts, int flags)
     }
 
 ex:
-    lua_remove(L, -2);				// objects w/nil
     lua_remove(L, -2);				// w/nil
 }
 
@@ -701,7 +754,7 @@ static typespec_t _determine_object_type(lua_State *L, void *p)
 	if (G_TYPE_IS_ENUM(type_nr) || G_TYPE_IS_FLAGS(type_nr))
 	    break;
 
-	ts = lg_find_struct(L, type_name, 1);
+	ts = lg_find_struct_gtype(L, type_nr, 1);
 	
 	/* found? if so, perform an integrity check */
 	if (ts.value) {
@@ -728,10 +781,52 @@ static typespec_t _determine_object_type(lua_State *L, void *p)
 }
 
 
+/* offset of the structure in the userdata of a value object */
+#define VALUE_OFFSET ((sizeof(struct object) + 7) & ~7)
+
+/**
+ * Push a new proxy object for a small structure that is stored in the
+ * userdata itself, initialized with zero.  Such value objects don't get
+ * an entry in the object map nor in aliases, and don't need to be freed;
+ * passed to a library function, the address of the structure within the
+ * userdata is used.  Therefore the library must not keep this address
+ * beyond the lifetime of the proxy object, and the structure must not be
+ * freed by a library function.
+ *
+ * @param L  Lua State
+ * @param ts  Type of the structure; must be native
+ * @return  The new proxy object, which is on the Lua stack.
+ */
+struct object *lg_new_value_object(lua_State *L, typespec_t ts)
+{
+    type_info_t ti = lg_get_type_info(ts);
+    int size = VALUE_OFFSET + ti->st.struct_size;
+    struct object *o;
+
+    o = (struct object*) lua_newuserdata(L, size);
+    memset(o, 0, size);
+    o->p = ((char*) o) + VALUE_OFFSET;
+    o->ts = ts;
+    o->is_new = 1;
+    lg_guess_object_type(L, o, FLAG_VALUE | FLAG_NEW_OBJECT);
+
+    _get_object_meta(L, ts);			// o meta
+    lua_setmetatable(L, -2);			// o
+
+    // see _make_object
+    lua_getglobal(L, LUAGNOME_TBL);		// o gnome
+    lua_getfield(L, -1, LUAGNOME_EMPTYATTR);	// o gnome emptyattr
+    lua_setfenv(L, -3);				// o gnome
+    lua_pop(L, 1);				// o
+
+    return o;
+}
+
+
 /**
  * Push a new Lua proxy object (struct object) onto the Lua stack.  It gets an
  * entry in the aliases table (unless it is a stack object); the caller must
- * take care of an entry in the objects table.
+ * take care of an entry in the object map.
  *
  * @param p  pointer to the object to make the Lua object for; must not be NULL.
  * @param ts  what the pointer type is; 0 for auto detect
@@ -788,25 +883,24 @@ static struct object *_make_object(lua_State *L, void *p, typespec_t ts,
     lua_getglobal(L, LUAGNOME_TBL);		// o gnome
     lua_getfield(L, -1, LUAGNOME_EMPTYATTR);	// o gnome emptyattr
     lua_setfenv(L, -3);				// o gnome
+    lua_pop(L, 1);				// o
 
     // Increase refcount (but not always - see ffi2lua_struct_ptr).  flags
     // may have FLAG_NEW_OBJECT set.
     lg_inc_refcount(L, o, flags);
 
-    // Stack objects neither get an entry in gnome.objects, nor in
-    // gnome.aliases.  They can't be reused anyway.
-    if (_is_on_stack(p)) {
-	lua_pop(L, 1);				// o
+    // Stack objects neither get an entry in the object map, nor in
+    // aliases.  They can't be reused anyway.
+    if (_is_on_stack(p))
 	return NULL;
-    }
 
     // Store the new object in the aliases table, using its own address
     // as a key.
-    lua_getfield(L, -1, LUAGNOME_ALIASES);	// o gnome aliases
-    lua_pushlightuserdata(L, o);		// o gnome aliases *o
-    lua_pushvalue(L, -4);			// o gnome aliases *o o
-    lua_rawset(L, -3);				// o gnome aliases
-    lua_pop(L, 2);				// o
+    lg_object_map_aliases(L);			// o aliases
+    lua_pushlightuserdata(L, o);		// o aliases *o
+    lua_pushvalue(L, -3);			// o aliases *o o
+    lua_rawset(L, -3);				// o aliases
+    lua_pop(L, 1);				// o
 
     return o;
 }
@@ -0,0 +1,259 @@
+/* vim:sw=4:sts=4
+ * Library to use the Gnome family of libraries from Lua 5.1
+ *
+ * Map of library object addresses to their Lua proxy objects.  This is a
+ * hash table with open addressing (linear probing) that maps the address of
+ * a library object to one of its proxy objects (struct object); the other
+ * aliases are found through the circular list in struct object.
+ *
+ * To push the proxy object onto the Lua stack, the table "aliases" is used;
+ * it maps the address of a struct object to the userdata and has weak
+ * values, so that the map doesn't keep proxy objects from being garbage
+ * collected.  Entries in the map are removed by lg_object_gc.
+ *
+ * Each Lua state has its own map, which is a userdata stored in the
+ * registry.  Its environment is the aliases table.
+ *
+ * Exported symbols:
+ *   lg_init_object_map
+ *   lg_object_map
+ *   lg_object_map_aliases
+ *   lg_object_map_lookup
+ *   lg_object_map_set
+ */
+
+#include "luagnome.h"
+#include <string.h>	    // memset
+
+struct object_map_entry {
+    void *p;			/* address of the library object; NULL=unused */
+    struct object *o;		/* one of the proxy objects for it */
+};
+
+struct object_map {
+    int size;			/* number of slots, a power of two */
+    int shift;			/* 32 - log2(size), see _map_hash */
+    int count;			/* slots in use */
+    int closed;			/* set when the Lua state is being closed */
+    struct object_map_entry *entries;
+};
+
+/* initial number of slots */
+#define OBJECT_MAP_MIN 256
+
+/* key of the object map in the registry; the address is used. */
+static const char _object_map_key = 0;
+
+
+/*-
+ * Object addresses are aligned, so the lowest bits carry no information.
+ * Multiplicative hashing: the low bits of the product only depend on the
+ * low bits of the address, therefore the top bits are used as slot number.
+ */
+static inline unsigned int _map_hash(const void *p, int shift)
+{
+    return ((unsigned int) ((unsigned long) p >> 3) * 2654435761u) >> shift;
+}
+
+
+/**
+ * Find the slot for the given address.  This is either the slot holding it,
+ * or the empty slot where it would be inserted.  The map must not be full.
+ */
+static inline struct object_map_entry *_map_find(struct object_map *map,
+    const void *p)
+{
+    unsigned int mask = map->size - 1, i = _map_hash(p, map->shift);
+    struct object_map_entry *e;
+
+    for (;;) {
+	e = map->entries + i;
+	if (e->p == p || !e->p)
+	    return e;
+	i = (i + 1) & mask;
+    }
+}
+
+
+/**
+ * Double the size of the map (or allocate it the first time) and reinsert
+ * all the entries.
+ */
+static void _map_grow(struct object_map *map)
+{
+    struct object_map_entry *old = map->entries, *e;
+    int i, old_size = map->size;
+
+    map->size = old_size ? old_size * 2 : OBJECT_MAP_MIN;
+    for (map->shift=32, i=map->size; i > 1; i >>= 1)
+	map->shift --;
+    map->entries = (struct object_map_entry*) g_malloc0(map->size
+	* sizeof(*map->entries));
+
+    for (i=0; i<old_size; i++)
+	if (old[i].p) {
+	    e = _map_find(map, old[i].p);
+	    *e = old[i];
+	}
+
+    g_free(old);
+}
+
+
+/**
+ * Remove an entry.  As linear probing is used, the entries following it
+ * in the same run are moved back where required, so that no "deleted"
+ * markers are needed.
+ */
+static void _map_remove(struct object_map *map, struct object_map_entry *e)
+{
+    unsigned int mask = map->size - 1, i = e - map->entries, j = i, k;
+
+    for (;;) {
+	j = (j + 1) & mask;
+	if (!map->entries[j].p)
+	    break;
+
+	// the entry at j may stay if its home slot k is cyclically in (i, j]
+	k = _map_hash(map->entries[j].p, map->shift);
+	if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+
+	map->entries[i] = map->entries[j];
+	i = j;
+    }
+
+    map->entries[i].p = NULL;
+    map->entries[i].o = NULL;
+    map->count --;
+}
+
+
+/**
+ * Look up the proxy object for a library object.
+ *
+ * @param map  The object map as returned by lg_object_map
+ * @param p  Address of the library object
+ * @return  One of the proxy objects, or NULL if none is known.  Note that
+ *   the proxy object may already be garbage, see lg_get_object.
+ */
+struct object *lg_object_map_lookup(struct object_map *map, const void *p)
+{
+    if (G_UNLIKELY(!map->count))
+	return NULL;
+    return _map_find(map, p)->o;
+}
+
+
+/**
+ * Set or remove the proxy object for the given address.
+ *
+ * @param map  The object map
+ * @param p  Address of the library object
+ * @param o  The proxy object to store, or NULL to remove the entry
+ */
+void lg_object_map_set(struct object_map *map, const void *p,
+    struct object *o)
+{
+    struct object_map_entry *e;
+
+    if (G_UNLIKELY(map->closed))
+	return;
+
+    if (!o) {
+	if (map->count) {
+	    e = _map_find(map, p);
+	    if (e->p)
+		_map_remove(map, e);
+	}
+	return;
+    }
+
+    // keep the load factor below 3/4
+    if (G_UNLIKELY((map->count + 1) * 4 > map->size * 3))
+	_map_grow(map);
+
+    e = _map_find(map, p);
+    if (!e->p) {
+	e->p = (void*) p;
+	map->count ++;
+    }
+    e->o = o;
+}
+
+
+/**
+ * Get the object map of this Lua state.
+ */
+struct object_map *lg_object_map(lua_State *L)
+{
+    struct object_map *map;
+
+    lua_pushlightuserdata(L, (void*) &_object_map_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    map = (struct object_map*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return map;
+}
+
+
+/**
+ * Get the object map of this Lua state, and push the aliases table.
+ */
+struct object_map *lg_object_map_aliases(lua_State *L)
+{
+    struct object_map *map;
+
+    lua_pushlightuserdata(L, (void*) &_object_map_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);	    // map
+    map = (struct object_map*) lua_touserdata(L, -1);
+    lua_getfenv(L, -1);			    // map aliases
+    lua_remove(L, -2);			    // aliases
+    return map;
+}
+
+
+/**
+ * The Lua state is being closed.  Proxy objects may still be collected
+ * after this, which must not access the entries anymore.
+ */
+static int _object_map_gc(lua_State *L)
+{
+    struct object_map *map = (struct object_map*) lua_touserdata(L, 1);
+
+    g_free(map->entries);
+    map->entries = NULL;
+    map->size = 0;
+    map->count = 0;
+    map->closed = 1;
+    return 0;
+}
+
+
+/**
+ * Create the object map and the aliases table for this Lua state.
+ */
+void lg_init_object_map(lua_State *L)
+{
+    struct object_map *map;
+
+    lua_pushlightuserdata(L, (void*) &_object_map_key);
+    map = (struct object_map*) lua_newuserdata(L, sizeof(*map));
+    memset(map, 0, sizeof(*map));
+
+    lua_newtable(L);			    // key map mt
+    lua_pushcfunction(L, _object_map_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);		    // key map
+
+    // aliases: with weak values, so that proxy objects can be collected.
+    lua_newtable(L);			    // key map aliases
+    lua_newtable(L);			    // key map aliases mt
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);		    // key map aliases
+    lua_setfenv(L, -2);			    // key map
+
+    lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
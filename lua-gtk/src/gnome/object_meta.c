@@ -7,11 +7,203 @@
  * Exported symbols:
  *  lg_object_index
  *  lg_object_newindex
+ *  lg_object_get_fields
+ *  lg_object_set_fields
+ *  lg_method_cache_generation
+ *  lg_method_cache_watch
  */
 
 #include "luagnome.h"
 #include <string.h>	    /* strlen, strncmp, strcpy, memset, memcpy */
 
+/*-
+ * Method cache.  Each class metatable has a hash set at index
+ * METHOD_CACHE_IDX with the keys, i.e. the addresses of the interned Lua
+ * strings, for which the whole class hierarchy has been searched without
+ * success.  Found entries need no such cache, as they are stored in the
+ * metatable of the class anyway.  The keys are kept alive by the environment
+ * of the cache.
+ *
+ * The entries may become invalid when another module is loaded, or when a
+ * new key is stored in a class metatable or a module table; both increase
+ * lg_method_cache_generation.
+ */
+#define METHOD_CACHE_IDX 1
+#define METHOD_CACHE_MIN 16
+#define METHOD_CACHE_META "LuaGnome.method_cache"
+#define CLASS_META_META "LuaGnome.class_meta"
+
+struct method_cache_entry {
+    const char *key;			/* interned Lua string */
+};
+
+struct method_cache {
+    int size, count;
+    int shift;				/* 32 - log2(size) */
+    int generation;			/* see lg_method_cache_generation */
+    struct method_cache_entry *entries;
+};
+
+volatile int lg_method_cache_generation = 0;
+
+
+/**
+ * Fibonacci hashing; the top bits of the product are the well mixed ones.
+ */
+static inline unsigned int _mc_hash(const char *key, int shift)
+{
+    return ((unsigned int) ((unsigned long) key >> 3) * 2654435761u) >> shift;
+}
+
+/**
+ * Find the slot for the key; either the one containing it, or the empty one
+ * where it would be inserted.
+ */
+static inline struct method_cache_entry *_mc_find(struct method_cache *mc,
+    const char *key)
+{
+    unsigned int mask = mc->size - 1, i = _mc_hash(key, mc->shift);
+    struct method_cache_entry *e;
+
+    for (;;) {
+	e = mc->entries + i;
+	if (e->key == key || !e->key)
+	    return e;
+	i = (i + 1) & mask;
+    }
+}
+
+static void _mc_insert(struct method_cache *mc, const char *key)
+{
+    struct method_cache_entry *old = mc->entries, *e;
+    int i, old_size = mc->size;
+
+    // keep the load factor at 1/2 at most; misses end at an empty slot.
+    if (G_UNLIKELY((mc->count + 1) * 2 > mc->size)) {
+	mc->size = old_size ? old_size * 2 : METHOD_CACHE_MIN;
+	for (mc->shift=32, i=mc->size; i > 1; i >>= 1)
+	    mc->shift --;
+	mc->entries = (struct method_cache_entry*) g_malloc0(mc->size
+	    * sizeof(*mc->entries));
+	for (i=0; i<old_size; i++)
+	    if (old[i].key)
+		*_mc_find(mc, old[i].key) = old[i];
+	g_free(old);
+    }
+
+    e = _mc_find(mc, key);
+    if (!e->key) {
+	e->key = key;
+	mc->count ++;
+    }
+}
+
+static int _mc_gc(lua_State *L)
+{
+    struct method_cache *mc = (struct method_cache*) lua_touserdata(L, 1);
+    g_free(mc->entries);
+    mc->entries = NULL;
+    mc->size = mc->count = 0;
+    return 0;
+}
+
+/**
+ * Get the method cache of a class, creating it if required.  Outdated
+ * entries are discarded.
+ *
+ * Input stack: [-1]=metatable of the class; unchanged on output.
+ */
+static struct method_cache *_get_method_cache(lua_State *L)
+{
+    struct method_cache *mc;
+
+    lua_rawgeti(L, -1, METHOD_CACHE_IDX);
+    mc = (struct method_cache*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (G_UNLIKELY(!mc)) {
+	mc = (struct method_cache*) lua_newuserdata(L, sizeof(*mc));
+	memset(mc, 0, sizeof(*mc));
+	mc->generation = lg_method_cache_generation;
+	if (luaL_newmetatable(L, METHOD_CACHE_META)) {
+	    lua_pushcfunction(L, _mc_gc);
+	    lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	lua_newtable(L);
+	lua_setfenv(L, -2);		    // mt mc
+	lua_rawseti(L, -2, METHOD_CACHE_IDX);
+    }
+
+    // all entries might be outdated, so clear the whole cache.
+    if (G_UNLIKELY(mc->generation != lg_method_cache_generation)) {
+	if (mc->count) {
+	    memset(mc->entries, 0, mc->size * sizeof(*mc->entries));
+	    mc->count = 0;
+	    lua_rawgeti(L, -1, METHOD_CACHE_IDX);
+	    lua_newtable(L);
+	    lua_setfenv(L, -2);
+	    lua_pop(L, 1);
+	}
+	mc->generation = lg_method_cache_generation;
+    }
+
+    return mc;
+}
+
+/**
+ * Remember that nothing was found for the key at stack position 2.
+ *
+ * Input stack: [-1]=metatable of the class; unchanged on output.
+ */
+static void _mc_insert_not_found(lua_State *L, struct method_cache *mc,
+    const char *key)
+{
+    _mc_insert(mc, key);
+
+    // keep the key string alive
+    lua_rawgeti(L, -1, METHOD_CACHE_IDX);
+    lua_getfenv(L, -1);
+    lua_pushvalue(L, 2);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);
+}
+
+/**
+ * __newindex for class metatables and module tables.  A new key may be one
+ * that a method cache has recorded as missing, so invalidate all of them.
+ */
+static int _watched_newindex(lua_State *L)
+{
+    lua_rawset(L, 1);
+    __sync_fetch_and_add(&lg_method_cache_generation, 1);
+    return 0;
+}
+
+/**
+ * Have writes of new keys into the table at the top of the stack invalidate
+ * the method caches.  Overwriting existing keys needs no such care, as those
+ * are never in a method cache.
+ *
+ * @param is_module  The table is a module table, which is its own metatable;
+ *   otherwise it is a class metatable.
+ */
+void lg_method_cache_watch(lua_State *L, int is_module)
+{
+    if (is_module) {
+	lua_pushcfunction(L, _watched_newindex);
+	lua_setfield(L, -2, "__newindex");
+	return;
+    }
+
+    if (luaL_newmetatable(L, CLASS_META_META)) {
+	lua_pushcfunction(L, _watched_newindex);
+	lua_setfield(L, -2, "__newindex");
+    }
+    lua_setmetatable(L, -2);
+}
+
 
 /**
  * Override?  This can be one defined in the gtk_methods[] array, i.e.
@@ -28,7 +220,20 @@ static int _check_override(lua_State *L, int module_idx, const char *name)
 	luaL_error(L, "%s internal error - _check_override called without "
 	    "module for %s", msgprefix, name);
 
-    lua_rawgeti(L, LUA_REGISTRYINDEX, mi->module_ref);
+    lua_pushlightuserdata(L, (void*) mi);
+    lua_rawget(L, LUA_REGISTRYINDEX);	// module table
+
+    // Types resolved by lg_type_normalize in another Lua state may refer
+    // to a module not yet loaded in this one.
+    if (G_UNLIKELY(lua_isnil(L, -1))) {
+	lua_pop(L, 1);
+	lua_getglobal(L, "require");
+	lua_pushstring(L, mi->name);
+	lua_call(L, 1, 0);
+	lua_pushlightuserdata(L, (void*) mi);
+	lua_rawget(L, LUA_REGISTRYINDEX);
+    }
+
     lua_pushstring(L, name);		// module name
     lua_rawget(L, -2);			// module item/null
     lua_remove(L, -2);			// item/null
@@ -157,7 +362,7 @@ static int _fe_check_interfaces(lua_State *L, const char *attr_name)
 	// Find that class;  It is perfectly OK not to find that class; at
 	// least, it should be in this module's list, but may not be mapped
 	// to anything, e.g. Atk not loaded.
-	typespec_t ts = lg_find_struct(L, class_name, 1);
+	typespec_t ts = lg_find_struct_gtype(L, gtypes[i], 1);
 	if (!ts.value)
 	    continue;
 
@@ -284,7 +489,7 @@ static int _fe_check_function(lua_State *L, int recursed, typespec_t ts)
  * @luaparam stack[-2] mt1  The object's metatable
  * @luaparam stack[-1] mt2  Metatable of object or one of its parents.
  */
-static int _fe_recurse(lua_State *L, int must_exist)
+static int _fe_recurse(lua_State *L)
 {
     int recursed = 0, rc;
     const char *attr_name;
@@ -344,13 +549,6 @@ static int _fe_recurse(lua_State *L, int must_exist)
     if (lg_find_func(L, mi, attr_name, &fi))
 	return _found_function(L, attr_name, &fi);
 
-    /* Give up.  Note that this is not an error when called from
-     * gtk_newindex.  Shows the class of the object. */
-    if (must_exist) {
-	struct object *o = (struct object*) lua_touserdata(L, 1);
-	return luaL_error(L, "%s %s.%s not found.", msgprefix,
-	    lg_get_object_name(o), attr_name);
-    }
     return 0;
 }
 
@@ -395,7 +593,8 @@ static int _array_access(lua_State *L, struct object *o)
  *
  * It handles accesses to methods and attributes found in this class or any
  * base class.  Once the method or attribute has been found, it is inserted
- * into the object's table to avoid looking it up again.
+ * into the object's table to avoid looking it up again; failed lookups are
+ * remembered in the method cache of the class.
  *
  * Input Stack: 1=object, 2=key
  * Output Stack: depends on the return value.
@@ -412,7 +611,8 @@ static int _find_element(lua_State *L, int must_exist)
 {
     struct object *w;
     const char *attr_name;
-    int type;
+    struct method_cache *mc;
+    int type, rc;
 
     /* check arguments. */
     if (lua_type(L, 1) != LUA_TUSERDATA)
@@ -450,12 +650,30 @@ static int _find_element(lua_State *L, int must_exist)
     if (_fe_check_env(L))
 	return 1;
 
+    // The key is an interned string, so its address identifies it.
+    mc = _get_method_cache(L);
+    if (mc->count && _mc_find(mc, attr_name)->key)
+	goto not_found;
+
     /* Duplicate the metatable; [-2] is the metatable of the object, and [-1]
      * is the current metatable as we ascend the object hierarchy. */
     lua_pushvalue(L, -1);
 
     /* stack: 1=object, 2=key, -2=destination metatable, -1=current metatable */
-    return _fe_recurse(L, must_exist);
+    rc = _fe_recurse(L);
+    if (rc)
+	return rc;
+
+    lua_pop(L, 1);			    // w key mt
+    _mc_insert_not_found(L, mc, attr_name);
+
+not_found:
+    /* Give up.  Note that this is not an error when called from
+     * gtk_newindex.  Shows the class of the object. */
+    if (must_exist)
+	return luaL_error(L, "%s %s.%s not found.", msgprefix,
+	    lg_get_object_name(w), attr_name);
+    return 0;
 }
 
 
@@ -503,20 +721,14 @@ static int _push_attribute(lua_State *L, typespec_t ts,
 
 
 /**
- * A meta entry is on the top of the stack; use it to retrieve the method
- * pointer or attribute value.
+ * Use a meta entry to retrieve the method pointer or attribute value.
  *
- * Stack: 1=object, 2=key, 3=dest metatable, 4=current metatable,... meta entry
+ * Stack: 1=object, 2=key, ...
  */
-static int _read_meta_entry(lua_State *L)
+static int _read_meta_entry(lua_State *L, const struct meta_entry *me)
 {
-    /* An override, built in or set by the user -- just return it. */
-    if (lua_type(L, -1) != LUA_TUSERDATA)
-	return 1;
-
     /* For functions, set up a c closure with one upvalue, which is the pointer
      * to the function info */
-    const struct meta_entry *me = lua_touserdata(L, -1);
     if (me->ts.value == 0)
 	return lg_push_closure(L, &me->fi, 0);
 
@@ -552,8 +764,11 @@ int lg_object_index(lua_State *L)
 	    return rc;
 	
 	case 2:
+	    /* An override, built in or set by the user -- just return it. */
+	    if (lua_type(L, -1) != LUA_TUSERDATA)
+		return 1;
 	    /* meta entry */
-	    return _read_meta_entry(L);
+	    return _read_meta_entry(L, lua_touserdata(L, -1));
 	
 	default:
 	    printf("%s invalid return code %d from find_element\n", msgprefix,
@@ -568,10 +783,11 @@ int lg_object_index(lua_State *L)
  *
  * @param L  Lua State
  * @param index  Stack position with a closure object
+ * @param me  Meta entry of the function
  */
-static int _try_overwrite_function(lua_State *L, int index)
+static int _try_overwrite_function(lua_State *L, int index,
+    const struct meta_entry *me)
 {
-    const struct meta_entry *me = lua_touserdata(L, -1);
     struct object *w = (struct object*) lua_touserdata(L, 1);
     const char *name = lua_tostring(L, 2);
     struct argconvs_t ar;
@@ -614,18 +830,19 @@ static int _try_overwrite_function(lua_State *L, int index)
 /**
  * Assignment to an attribute of a structure.  Must not be a built-in
  * method, but basically could be...
- * Stack: 1=object, 2=key, ... [-1]=meta entry
+ * Stack: 1=object, 2=key, ...
  *
  * @param index  Lua stack position where the value is at
+ * @param me  The meta entry describing the attribute
  */
-static int _write_meta_entry(lua_State *L, int index)
+static int _write_meta_entry(lua_State *L, int index,
+    const struct meta_entry *me)
 {
-    const struct meta_entry *me = lua_touserdata(L, -1);
     struct object *w = (struct object*) lua_touserdata(L, 1);
 
     /* the meta entry must describe a structure element, not a method. */
     if (G_UNLIKELY(me->ts.value == 0))
-	return _try_overwrite_function(L, index);
+	return _try_overwrite_function(L, index, me);
 
     /* write to attribute using a type-specific handler */
     typespec_t ts = me->ts;
@@ -678,7 +895,8 @@ int lg_object_newindex(lua_State *L)
 	    return 0;
 
 	case 2:
-	    _write_meta_entry(L, 3);
+	    _write_meta_entry(L, 3, (const struct meta_entry*)
+		lua_touserdata(L, -1));
 	    return 0;
     }
 
@@ -708,3 +926,237 @@ int lg_object_newindex(lua_State *L)
 }
 
 
+
+/*-
+ * Field plans for get_fields and set_fields.  The list of field names given
+ * by the caller is resolved once into the structure elements and their
+ * types.  The plans are stored at index FIELD_PLAN_IDX of the class
+ * metatable, in a table with weak keys that maps the table of names to the
+ * plan; therefore the same table of names should be used for each call.
+ * As the table may be changed, each use compares its names with those of the
+ * plan.  Like the method cache, plans are discarded when another module is
+ * loaded or a class metatable is extended.  The environment of a plan keeps
+ * the names and the meta entries alive.
+ */
+#define FIELD_PLAN_IDX 2
+
+struct field_plan_entry {
+    const char *name;			/* interned Lua string */
+    const struct meta_entry *me;	/* the structure element */
+    typespec_t ts;			/* normalized type of the element */
+    int conv_idx;			/* structconv_idx of this type */
+};
+
+struct field_plan {
+    int generation;			/* see lg_method_cache_generation */
+    int count;
+    struct field_plan_entry fields[0];
+};
+
+
+/**
+ * Resolve the names of the fields, using the usual lookup of attributes.
+ *
+ * Stack: [1]=object [2]=names ... [-1]=plans; unchanged on output.
+ */
+static struct field_plan *_build_field_plan(lua_State *L)
+{
+    int plans_idx = lua_gettop(L), names_idx = plans_idx + 1, plan_idx,
+	env_idx, n, i;
+    struct field_plan *fp;
+    struct field_plan_entry *fe;
+    const struct meta_entry *me;
+    int rc;
+
+    lua_pushvalue(L, 2);
+    n = lua_objlen(L, names_idx);
+    fp = (struct field_plan*) lua_newuserdata(L, sizeof(*fp)
+	+ n * sizeof(*fp->fields));
+    plan_idx = lua_gettop(L);
+    fp->generation = lg_method_cache_generation;
+    fp->count = n;
+    lua_newtable(L);
+    env_idx = lua_gettop(L);
+
+    // _find_element expects the key at stack position 2.
+    for (i=0; i<n; i++) {
+	lua_rawgeti(L, names_idx, i + 1);
+	if (lua_type(L, -1) != LUA_TSTRING)
+	    luaL_error(L, "%s field name %d is not a string", msgprefix, i + 1);
+	lua_replace(L, 2);
+
+	rc = _find_element(L, 1);
+	if (rc == 2 && lua_type(L, -1) == LUA_TUSERDATA)
+	    me = (const struct meta_entry*) lua_touserdata(L, -1);
+	else
+	    me = NULL;
+	if (!me || me->ts.value == 0)
+	    luaL_error(L, "%s %s.%s is not a field", msgprefix,
+		lg_get_object_name((struct object*) lua_touserdata(L, 1)),
+		lua_tostring(L, 2));
+
+	fe = fp->fields + i;
+	fe->name = lua_tostring(L, 2);
+	fe->me = me;
+	fe->ts = me->ts;
+	fe->ts.type_idx = me->se->type_idx;
+	fe->ts = lg_type_normalize(L, fe->ts);
+	fe->conv_idx = lg_get_ffi_type(fe->ts)->structconv_idx;
+
+	// env[name] = meta entry
+	lua_pushvalue(L, 2);
+	lua_insert(L, -2);
+	lua_rawset(L, env_idx);
+	lua_settop(L, env_idx);
+    }
+
+    lua_setfenv(L, plan_idx);
+    lua_pushvalue(L, names_idx);
+    lua_replace(L, 2);
+
+    // plans[names] = plan
+    lua_rawset(L, plans_idx);
+    return fp;
+}
+
+
+/**
+ * Check that the table of names at stack position 2 still has the names the
+ * plan was built for.
+ */
+static int _field_plan_matches(lua_State *L, struct field_plan *fp)
+{
+    int i, ok = 1;
+
+    if (G_UNLIKELY((int) lua_objlen(L, 2) != fp->count))
+	return 0;
+
+    for (i=0; ok && i<fp->count; i++) {
+	lua_rawgeti(L, 2, i + 1);
+	ok = lua_type(L, -1) == LUA_TSTRING
+	    && lua_tostring(L, -1) == fp->fields[i].name;
+	lua_pop(L, 1);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Get the field plan for the table of names at stack position 2.
+ *
+ * Stack: [1]=object [2]=names; unchanged on output.
+ */
+static struct field_plan *_get_field_plan(lua_State *L)
+{
+    struct field_plan *fp;
+
+    luaL_checktype(L, 1, LUA_TUSERDATA);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    if (!((struct object*) lua_touserdata(L, 1))->p)
+	luaL_error(L, "%s access to fields of a NULL object", msgprefix);
+    if (!lua_getmetatable(L, 1))
+	luaL_argerror(L, 1, "object expected");
+
+    lua_rawgeti(L, -1, FIELD_PLAN_IDX);		// mt plans|nil
+    if (G_UNLIKELY(lua_isnil(L, -1))) {
+	lua_pop(L, 1);
+	lua_newtable(L);			// mt plans
+	lua_newtable(L);
+	lua_pushliteral(L, "k");
+	lua_setfield(L, -2, "__mode");
+	lua_setmetatable(L, -2);
+	lua_pushvalue(L, -1);
+	lua_rawseti(L, -3, FIELD_PLAN_IDX);
+    }
+
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);				// mt plans plan|nil
+    fp = (struct field_plan*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (G_UNLIKELY(!fp || fp->generation != lg_method_cache_generation
+	|| !_field_plan_matches(L, fp)))
+	fp = _build_field_plan(L);
+
+    lua_pop(L, 2);
+    return fp;
+}
+
+
+/**
+ * Read several fields of a structure at once.
+ *
+ * @name get_fields
+ * @luaparam object  The object
+ * @luaparam names  Table with the names of the fields; reuse it for
+ *   further calls, as the lookup of the names is cached for it.
+ * @luareturn  The values of the fields, in the order of the names.
+ */
+int lg_object_get_fields(lua_State *L)
+{
+    struct field_plan *fp = _get_field_plan(L);
+    struct field_plan_entry *fe = fp->fields;
+    struct object *o = (struct object*) lua_touserdata(L, 1);
+    struct argconvs_t ar;
+    int i, top;
+
+    luaL_checkstack(L, fp->count, "too many fields");
+    ar.L = L;
+    ar.ptr = o->p;
+
+    for (i=0; i<fp->count; i++, fe++) {
+	if (G_UNLIKELY(!fe->conv_idx || !ffi_type_struct2lua[fe->conv_idx]))
+	    return luaL_error(L, "%s unhandled attribute type %s (%s)",
+		msgprefix, lg_get_type_name(fe->ts), fe->me->name);
+	ar.se = fe->me->se;
+	ar.ts = fe->ts;
+	top = lua_gettop(L);
+	if (!ffi_type_struct2lua[fe->conv_idx](&ar))
+	    lua_settop(L, top + 1);
+    }
+
+    return fp->count;
+}
+
+
+/**
+ * Write several fields of a structure at once.
+ *
+ * @name set_fields
+ * @luaparam object  The object
+ * @luaparam names  Table with the names of the fields, see get_fields
+ * @luaparam values  Table with the values in the same order as the names;
+ *   fields with a nil value are not changed.
+ */
+int lg_object_set_fields(lua_State *L)
+{
+    struct field_plan *fp = _get_field_plan(L);
+    struct field_plan_entry *fe = fp->fields;
+    struct object *o = (struct object*) lua_touserdata(L, 1);
+    struct argconvs_t ar;
+    int i;
+
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_settop(L, 3);
+    ar.L = L;
+    ar.ptr = o->p;
+    ar.index = 4;
+
+    for (i=0; i<fp->count; i++, fe++) {
+	lua_rawgeti(L, 3, i + 1);
+	if (!lua_isnil(L, 4)) {
+	    if (G_UNLIKELY(!fe->conv_idx || !ffi_type_lua2struct[fe->conv_idx]))
+		return luaL_error(L, "%s can't write %s.%s (unsupported "
+		    "type %s)", msgprefix, lg_get_object_name(o),
+		    fe->me->name, lg_get_type_name(fe->ts));
+	    ar.se = fe->me->se;
+	    ar.ts = fe->ts;
+	    ffi_type_lua2struct[fe->conv_idx](&ar);
+	}
+	lua_settop(L, 3);
+    }
+
+    return 0;
+}
+
@@ -22,6 +22,32 @@
 static int next_type_nr = 0;
 static struct object_type *object_types = NULL;
 
+/* protects object_types when registering types from different threads */
+static volatile int object_types_lock = 0;
+
+/*-
+ * The handlers' scores depend only on the type of the object and the flags
+ * (and, for the plain handler, whether it is on the stack), so the winner
+ * is remembered.  This is a direct mapped cache per thread; entries from
+ * before the last registration of an object type are invalid.
+ */
+#define MM_TYPE_CACHE_SIZE 256	    /* must be a power of two */
+#define MM_FLAG_ON_STACK 0x8000	    /* added to flags in the key */
+
+struct mm_type_cache_entry {
+    typespec_t ts;
+    int flags;
+    int mm_type;
+    int generation;
+};
+
+static LG_THREAD_LOCAL struct mm_type_cache_entry
+    mm_type_cache[MM_TYPE_CACHE_SIZE];
+
+/* incremented when an object type is registered; starts at 1, so that
+ * unused cache entries are invalid. */
+static volatile int mm_type_generation = 1;
+
 /**
  * Free a GValue.  It might contain a string, for example, meaning additional
  * allocated memory.  This is freed.
@@ -215,18 +241,35 @@ int lg_call_object_handler(struct object *w, object_op op, int flags,
     return -1;
 }
 
+static inline int _is_on_stack(void *p);
+
 /**
  * Determine the mm_type for a new object proxy object.  This type
  * determines how the memory of this object is managed - is reference
  * counting used, should it be free()d or nothing done, etc.
  *
+ * Each handler is asked for its score for the object; the result is
+ * remembered for the object's type and the flags.
+ *
  * @param L  Lua State
  * @param w  The new object
  * @param flags  any of the FLAG_xxx constants: FLAG_NEW_OBJECT, FLAG_ALLOCATED
  */
 void lg_guess_object_type(lua_State *L, struct object *w, int flags)
 {
-    int i, type_nr=-1, score=0;
+    int i, type_nr=-1, score=0, key_flags;
+    struct mm_type_cache_entry *e;
+    typespec_t ts = w->ts;
+
+    ts.flag = 0;
+    key_flags = flags | (_is_on_stack(w->p) ? MM_FLAG_ON_STACK : 0);
+    e = mm_type_cache + ((ts.value * 31u + key_flags)
+	& (MM_TYPE_CACHE_SIZE - 1));
+    if (G_LIKELY(e->generation == mm_type_generation
+	&& e->ts.value == ts.value && e->flags == key_flags)) {
+	w->mm_type = e->mm_type;
+	return;
+    }
 
     for (i=0; i<next_type_nr; i++) {
 	int rc = object_types[i].handler(w, WIDGET_SCORE, flags);
@@ -243,6 +286,10 @@ void lg_guess_object_type(lua_State *L, struct object *w, int flags)
     }
 
     w->mm_type = type_nr;
+    e->ts = ts;
+    e->flags = key_flags;
+    e->mm_type = type_nr;
+    e->generation = mm_type_generation;
 }
 
 
@@ -253,16 +300,32 @@ void lg_guess_object_type(lua_State *L, struct object *w, int flags)
  *
  * @param name  Short name for this object type (for debugging output)
  * @param handler  A function to handle various tasks
- * @return  The type_nr assigned to this object type.
+ * @return  The type_nr assigned to this object type.  When this name has
+ *   already been registered, e.g. by another Lua state, its type_nr is
+ *   returned.
  */
 int lg_register_object_type(const char *name, object_handler handler)
 {
-    int type_nr = next_type_nr ++;
-    object_types = (struct object_type*) g_realloc(object_types,
-	next_type_nr * sizeof(*object_types));
-    struct object_type *wt = object_types + type_nr;
-    wt->name = name;
-    wt->handler = handler;
+    int type_nr;
+
+    LG_LOCK(object_types_lock);
+    for (type_nr=0; type_nr<next_type_nr; type_nr++)
+	if (!strcmp(name, object_types[type_nr].name))
+	    break;
+
+    if (type_nr == next_type_nr) {
+	next_type_nr ++;
+	object_types = (struct object_type*) g_realloc(object_types,
+	    next_type_nr * sizeof(*object_types));
+	struct object_type *wt = object_types + type_nr;
+	wt->name = name;
+	wt->handler = handler;
+
+	// the new handler might win for some objects.
+	mm_type_generation ++;
+    }
+    LG_UNLOCK(object_types_lock);
+
     return type_nr;
 }
 
@@ -351,6 +414,17 @@ static int _malloc_handler(struct object *w, object_op op, int flags)
     return 0;
 }
 
+/**
+ * Handler for value objects, i.e. structures stored in the proxy object
+ * itself (see lg_new_value_object).  Their memory is freed with the proxy.
+ */
+static int _value_handler(struct object *w, object_op op, int flags)
+{
+    if (op == WIDGET_SCORE)
+	return flags & FLAG_VALUE ? 2000 : 0;
+    return 0;
+}
+
 static int _array_handler(struct object *w, object_op op, int flags)
 {
     switch (op) {
@@ -369,14 +443,15 @@ static int _array_handler(struct object *w, object_op op, int flags)
 
 
 /**
- * Initialize the object type handlers defined in this module.  There currently
- * is one more (in channel.c).
+ * Initialize the object type handlers defined in this module.  Other modules
+ * register more, e.g. glib/channel.c.
  */
 void lg_init_object(lua_State *L)
 {
     lg_register_object_type("plain", _plain_handler);
     lg_register_object_type("malloc", _malloc_handler);
     lg_register_object_type("array", _array_handler);
+    lg_register_object_type("value", _value_handler);
 }
 
 
@@ -0,0 +1,269 @@
+/* vim:sw=4:sts=4
+ * Lua binding for the Gtk 2 toolkit.
+ * Runtime profiling of library function calls and callbacks.  This is
+ * enabled by the debug flag "profile", see debug.c.
+ *
+ * Exported symbols:
+ *   lg_profile_time
+ *   lg_profile_get
+ *   lg_profile_add
+ *   lg_init_profile
+ */
+
+/**
+ * @class module
+ * @name gtk_internal.profile
+ */
+
+#include "luagnome.h"
+#include <stdlib.h>	    // atexit, qsort
+#include <time.h>	    // clock_gettime
+
+/* Statistics for one library function or one callback type. */
+struct lg_profile {
+    const char *name;		/* g_strdup()ed */
+    unsigned int is_callback : 1;
+    unsigned long calls;	/* number of calls */
+    gint64 total;		/* total time in nanoseconds */
+    gint64 max;			/* longest call */
+    gint64 conv;		/* time spent converting arguments */
+};
+/* For library functions, the time not spent in conversion is spent in the
+ * library function; for callbacks, in the Lua function.  Note that both
+ * include the time of nested calls, e.g. of callbacks run by gtk_main. */
+
+/* struct lg_profile entries keyed by the function address, or by the
+ * prototype of the callback */
+static GHashTable *profiles = NULL;
+
+/* protects profiles and the entries in it, which are shared by all threads */
+static volatile int profile_lock = 0;
+
+
+/**
+ * Current time of a monotonic clock in nanoseconds.  Where no such clock
+ * is available, the wall clock is used, which has a resolution of only one
+ * microsecond.
+ */
+gint64 lg_profile_time()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    GTimeVal tv;
+
+    g_get_current_time(&tv);
+    return ((gint64) tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec) * 1000;
+#endif
+}
+
+
+static int _profile_compare(const void *_a, const void *_b)
+{
+    const struct lg_profile *a = *(const struct lg_profile**) _a;
+    const struct lg_profile *b = *(const struct lg_profile**) _b;
+
+    if (a->total != b->total)
+	return a->total > b->total ? -1 : 1;
+    return a->calls > b->calls ? -1 : a->calls < b->calls;
+}
+
+
+/**
+ * Get all profile entries sorted by descending total time.
+ *
+ * @param count  (output) number of entries
+ * @return  A newly allocated array that must be freed with g_free.
+ */
+static struct lg_profile **_profile_sorted(int *count)
+{
+    struct lg_profile **list;
+    GHashTableIter iter;
+    gpointer p;
+    int n = 0;
+
+    LG_LOCK(profile_lock);
+    *count = profiles ? g_hash_table_size(profiles) : 0;
+    list = (struct lg_profile**) g_malloc(sizeof(*list) * (*count + 1));
+
+    if (profiles) {
+	g_hash_table_iter_init(&iter, profiles);
+	while (g_hash_table_iter_next(&iter, NULL, &p))
+	    list[n++] = (struct lg_profile*) p;
+    }
+    LG_UNLOCK(profile_lock);
+
+    qsort(list, n, sizeof(*list), _profile_compare);
+    return list;
+}
+
+
+/**
+ * At program exit, show the collected profile.  Times are in milliseconds.
+ */
+static void _profile_dump()
+{
+    struct lg_profile **list, *p;
+    int i, n;
+
+    list = _profile_sorted(&n);
+    if (n) {
+	printf("%s profile: %-40s %9s %11s %9s %11s %11s\n", msgprefix,
+	    "function", "calls", "total", "max", "conversion", "call");
+	for (i=0; i<n; i++) {
+	    p = list[i];
+	    if (!p->calls)
+		continue;
+	    printf("%s profile: %-40s %9lu %11.3f %9.3f %11.3f %11.3f%s\n",
+		msgprefix, p->name, p->calls, p->total / 1e6,
+		p->max / 1e6, p->conv / 1e6,
+		(p->total - p->conv) / 1e6,
+		p->is_callback ? " (callback)" : "");
+	}
+    }
+    g_free(list);
+}
+
+
+/**
+ * Find the profile entry for a function or callback, or create a new one.
+ *
+ * @param key  Function address, or the prototype of a callback
+ * @param name  Name to show for this entry; is copied
+ * @param is_callback  True if this is for a callback
+ * @return  The profile entry.
+ */
+struct lg_profile *lg_profile_get(const void *key, const char *name,
+    int is_callback)
+{
+    struct lg_profile *p;
+
+    LG_LOCK(profile_lock);
+    if (G_UNLIKELY(!profiles)) {
+	profiles = g_hash_table_new(g_direct_hash, g_direct_equal);
+	atexit(_profile_dump);
+    }
+
+    p = (struct lg_profile*) g_hash_table_lookup(profiles, key);
+    if (!p) {
+	p = g_slice_new0(struct lg_profile);
+	p->name = g_strdup(name);
+	p->is_callback = is_callback ? 1 : 0;
+	g_hash_table_insert(profiles, (gpointer) key, p);
+    }
+    LG_UNLOCK(profile_lock);
+
+    return p;
+}
+
+
+/**
+ * Add the timing of one call to a profile entry.  All times are taken
+ * with lg_profile_time.
+ *
+ * @param p  The profile entry
+ * @param t_start  Start of the call, i.e. before converting arguments
+ * @param t_call  Right before calling the function
+ * @param t_return  Right after the function returned
+ * @param t_end  After converting the return values
+ */
+void lg_profile_add(struct lg_profile *p, gint64 t_start, gint64 t_call,
+    gint64 t_return, gint64 t_end)
+{
+    gint64 total = t_end - t_start;
+
+    LG_LOCK(profile_lock);
+    p->calls ++;
+    p->total += total;
+    p->conv += total - (t_return - t_call);
+    if (total > p->max)
+	p->max = total;
+    LG_UNLOCK(profile_lock);
+}
+
+
+/**
+ * Get the profile collected since the debug flag "profile" was set, or since
+ * the last call to reset_profile.  Times are in seconds.
+ *
+ * @name get_profile
+ * @luareturn  An array sorted by descending total time; each entry is a
+ *   table with the fields name, calls, total, max, conv (time to convert
+ *   arguments and return values), call (time spent in the function) and
+ *   callback (true for callbacks from C to Lua).
+ */
+static int l_get_profile(lua_State *L)
+{
+    struct lg_profile **list, *p;
+    int i, n, idx = 0;
+
+    list = _profile_sorted(&n);
+    lua_createtable(L, n, 0);
+    for (i=0; i<n; i++) {
+	p = list[i];
+	if (!p->calls)
+	    continue;
+	lua_createtable(L, 0, 7);
+	lua_pushstring(L, p->name);
+	lua_setfield(L, -2, "name");
+	lua_pushnumber(L, p->calls);
+	lua_setfield(L, -2, "calls");
+	lua_pushnumber(L, p->total / 1e9);
+	lua_setfield(L, -2, "total");
+	lua_pushnumber(L, p->max / 1e9);
+	lua_setfield(L, -2, "max");
+	lua_pushnumber(L, p->conv / 1e9);
+	lua_setfield(L, -2, "conv");
+	lua_pushnumber(L, (p->total - p->conv) / 1e9);
+	lua_setfield(L, -2, "call");
+	lua_pushboolean(L, p->is_callback);
+	lua_setfield(L, -2, "callback");
+	lua_rawseti(L, -2, ++idx);
+    }
+    g_free(list);
+
+    return 1;
+}
+
+
+/**
+ * Clear all the collected profile data.
+ *
+ * @name reset_profile
+ */
+static int l_reset_profile(lua_State *L)
+{
+    GHashTableIter iter;
+    gpointer v;
+    struct lg_profile *p;
+
+    LG_LOCK(profile_lock);
+    if (profiles) {
+	g_hash_table_iter_init(&iter, profiles);
+	while (g_hash_table_iter_next(&iter, NULL, &v)) {
+	    p = (struct lg_profile*) v;
+	    p->calls = 0;
+	    p->total = p->max = p->conv = 0;
+	}
+    }
+    LG_UNLOCK(profile_lock);
+
+    return 0;
+}
+
+
+static const luaL_reg profile_methods[] = {
+    {"get_profile",	l_get_profile },
+    {"reset_profile",	l_reset_profile },
+    { NULL, NULL }
+};
+
+/* Register the profiling functions in the gnome table */
+void lg_init_profile(lua_State *L)
+{
+    luaL_register(L, NULL, profile_methods);
+}
+
@@ -10,10 +10,21 @@ linklist = {
     -- implicitly used in callback.c:_callback in the macro G_VALUE_COLLECT
     { "g_assertion_message", "glib >= '2.15'" },
     "g_boxed_type_register_static",
+    "g_direct_equal",		    -- call.c: cif cache
+    "g_direct_hash",
     "g_enum_get_value",
     "g_flags_get_first_value",
     "g_free",
+    "g_get_current_time",	    -- profile.c
+    "g_hash_table_destroy",
+    "g_hash_table_insert",
+    "g_hash_table_iter_init",
+    "g_hash_table_iter_next",
+    "g_hash_table_lookup",
+    "g_hash_table_new",
+    "g_hash_table_size",
     "g_malloc",
+    "g_malloc0",
     "g_strdup",
     "g_mem_gc_friendly",
     "g_mem_profile",
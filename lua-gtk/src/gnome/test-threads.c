@@ -0,0 +1,84 @@
+/** vim:sw=4:sts=4
+ * Stress test for running several Lua states in parallel threads, each of
+ * which loads the glib module and calls library functions in a loop.  This
+ * exercises the per-thread call machinery (pool of call_info structures,
+ * arenas) and the shared, locked call plan cache.
+ *
+ * The modules are found via the usual package.cpath, i.e. they have to be
+ * installed or LUA_CPATH must be set.  When run, returns 0 on success, or a
+ * non-zero exit status on error.
+ *
+ * Note that Gtk itself must only be used by one thread; therefore only GLib
+ * functions are called here.
+ */
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+#include <glib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREAD_COUNT 8		/* must be at most 10, see script */
+#define LOOPS 20000
+
+static const char script[] =
+    "require 'glib'\n"
+    "local id, loops = ...\n"
+    "for i = 1, loops do\n"
+    "    local s = string.format('%d-%d', id, i)\n"
+    "    assert(glib.str_hash(s) == glib.str_hash(s))\n"
+    "    assert(glib.str_equal(s, id .. '-' .. i))\n"
+    "    assert(glib.strrstr('abc' .. s, s) == s)\n"
+    "    assert(glib.ascii_digit_value(string.byte(s)) == id % 10)\n"
+    "end\n";
+
+/**
+ * Body of one thread: create a Lua state, run the script and report errors.
+ */
+static void *_thread_func(void *arg)
+{
+    int id = (int) (long) arg, rc;
+    lua_State *L = luaL_newstate();
+
+    luaL_openlibs(L);
+    rc = luaL_loadbuffer(L, script, sizeof(script) - 1, "test-threads");
+    if (!rc) {
+	lua_pushinteger(L, id);
+	lua_pushinteger(L, LOOPS);
+	rc = lua_pcall(L, 2, 0, 0);
+    }
+    if (rc)
+	fprintf(stderr, "thread %d: %s\n", id, lua_tostring(L, -1));
+
+    lua_close(L);
+    return (void*) (long) rc;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[THREAD_COUNT];
+    void *rc;
+    int i, errors = 0;
+
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_init(NULL);
+#endif
+
+    for (i=0; i<THREAD_COUNT; i++)
+	if (pthread_create(&threads[i], NULL, _thread_func, (void*) (long) i)) {
+	    fprintf(stderr, "can't create thread %d\n", i);
+	    return 1;
+	}
+
+    for (i=0; i<THREAD_COUNT; i++) {
+	pthread_join(threads[i], &rc);
+	if (rc)
+	    errors ++;
+    }
+
+    printf("%d threads, %d errors\n", THREAD_COUNT, errors);
+    return errors ? 1 : 0;
+}
+
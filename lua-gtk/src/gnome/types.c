@@ -217,8 +217,8 @@ static int lua2ffi_enum(struct argconv_t *ar)
 	    ar->arg->l = (long) lua_tonumber(L, ar->index);
 
 	    // for zero it is probably OK; like for gtk_table_attach, when
-	    // xoptions should be zero.
-	    if (ar->arg->l != 0) {
+	    // xoptions should be zero.  Numbers are expected in integer mode.
+	    if (ar->arg->l != 0 && !lg_enum_is_integer(ar->ts)) {
 		LG_MESSAGE(13, "Arg %d enum (type %s) given as number\n",
 		    ar->func_arg_nr, lg_get_type_name(ar->ts));
 		call_info_msg(L, ar->ci, LUAGNOME_WARNING);
@@ -433,7 +433,7 @@ static int lua2ffi_func_ptr(struct argconv_t *ar)
 	// create a temporary closure.  It is added to the Lua stack
 	// (stack_curr_top is incremented), so that it can't be garbage
 	// collected until the library function is done.
-	lg_create_closure(ar->L, ar->index, 1);
+	lg_create_closure(ar->L, ar->index, ar->ci);
 	ar->stack_curr_top ++;
 	index = -1;
 	// fall through
@@ -750,7 +750,7 @@ static void _store_int(lua_State *L, void *p, int conv_idx, int index)
  * This works for int, unsigned int, long int, unsigned long int.
  *
  * Input, e.g. for gdk_pango_layout_get_clip_region.  Use as such when an array
- * (of numbers) is given.
+ * (of numbers) or an array view (see array.c) is given.
  * Output in other cases.  Initialize with whatever the user passed as
  * parameter.
  */
@@ -774,6 +774,11 @@ static int lua2ffi_int_ptr(struct argconv_t *ar)
 	return 1;
     }
 
+    /* an array view - use its memory directly */
+    if (ar->lua_type == LUA_TUSERDATA
+	&& (ar->arg->p = lg_array_view_ptr(L, index, bytes, 0)))
+	return 1;
+
     /* If no table is given, then this is an output value.  Allocate some
      * space for it, and set the pointer to it. */
     if (ar->lua_type != LUA_TTABLE) {
@@ -800,7 +805,7 @@ static int lua2ffi_int_ptr(struct argconv_t *ar)
 }
 
 /**
- * Array of doubles - as input
+ * Array of doubles - as input, given as table or array view.
  */
 static int lua2ffi_double_ptr(struct argconv_t *ar)
 {
@@ -825,6 +830,10 @@ static int lua2ffi_double_ptr(struct argconv_t *ar)
     }
 
 
+    if (ar->lua_type == LUA_TUSERDATA
+	&& (ar->arg->p = lg_array_view_ptr(L, index, sizeof(double), 1)))
+	return 1;
+
     /* A table should be given. */
     if (ar->lua_type != LUA_TTABLE)
 	luaL_error(L, "%s table or nil expected for the double* argument.",
@@ -1107,7 +1116,7 @@ static typespec_t _guess_type_idx(lua_State *L, void *p, typespec_t ts)
     my_type = G_TYPE_FROM_INSTANCE(p);
     type_name = g_type_name(my_type);
 
-    typespec_t ts2 = lg_find_struct(L, type_name, 1);
+    typespec_t ts2 = lg_find_struct_gtype(L, my_type, 1);
     if (!ts2.value) {
 	// If the specified type is GObject, then we can let it be determined
 	// automatically.  For callbacks, this can be required, e.g. when
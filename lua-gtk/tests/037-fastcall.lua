@@ -0,0 +1,56 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Library functions with very common signatures are called through direct
+-- call stubs instead of libffi.  Verify that the results are the same as
+-- with the generic path.
+
+require "gtk"
+
+function run()
+    local res = {}
+    local win = gtk.window_new(gtk.WINDOW_TOPLEVEL)
+    local lbl = gtk.label_new("hello")
+
+    win:add(lbl)			    -- void f(ptr, ptr)
+    lbl:set_selectable(true)		    -- void f(ptr, int)
+    lbl:set_width_chars(-5)
+    res[#res + 1] = lbl:get_selectable()    -- int f(ptr)
+    res[#res + 1] = lbl:get_width_chars()
+    res[#res + 1] = lbl:get_text()	    -- ptr f(ptr)
+    res[#res + 1] = win:get_child() == lbl
+    win:show_all()			    -- void f(ptr)
+    win:destroy()
+
+    return res
+end
+
+fast = run()
+
+-- A function with an argument whose type has no ffi type, e.g. wchar_t or
+-- a complex number passed by value, must raise an error when called instead
+-- of crashing in libffi.  The bundled modules have no such function on
+-- Linux, so give them on the command line, e.g. "glib.some_function".
+for _, name in ipairs(arg or {}) do
+    local mod, func = name:match"^(%w+)%.(.+)$"
+    rc, msg = pcall(_G[mod][func])
+    assert(not rc, name .. " should fail")
+    assert(msg:match"call error", msg)
+end
+
+-- the debug flags are not available when compiled without debug functions.
+if not gnome.set_debug_flags then return end
+
+gnome.set_debug_flags "nofastcall"
+generic = run()
+gnome.unset_debug_flags "nofastcall"
+
+assert(#fast == #generic)
+for i, v in ipairs(fast) do
+    assert(v == generic[i], string.format("result %d differs: %s vs %s",
+	i, tostring(v), tostring(generic[i])))
+end
+assert(fast[1] == true)
+assert(fast[2] == -5)
+assert(fast[3] == "hello")
+assert(fast[4] == true)
+
@@ -0,0 +1,31 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Call a list of library functions with gnome.batch.
+
+require "gtk"
+
+lbl = gtk.label_new("")
+win = gtk.window_new(gtk.WINDOW_TOPLEVEL)
+
+res = gnome.batch {
+    { lbl.set_text, lbl, "hello" },
+    { lbl.get_text, lbl },
+    { win.add, win, lbl },
+    { win.get_child, win },
+    { gtk.label_set_width_chars, lbl, 7 },
+    { gtk.label_get_width_chars, lbl },
+}
+
+assert(res[1] == nil)
+assert(res[2] == "hello")
+assert(res[3] == nil)
+assert(res[4] == lbl)
+assert(res[6] == 7)
+assert(lbl:get_text() == "hello")
+
+-- an invalid entry raises an error
+rc, msg = pcall(gnome.batch, { { print, "x" } })
+assert(not rc)
+
+win:destroy()
+
@@ -0,0 +1,34 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Runtime profiling of library calls.
+
+require "gtk"
+
+-- the debug flags are not available when compiled without debug functions.
+if not gnome.set_debug_flags then return end
+
+gnome.set_debug_flags "profile"
+lbl = gtk.label_new("")
+for i = 1, 10 do
+    lbl:set_text(tostring(i))
+end
+gnome.unset_debug_flags "profile"
+
+-- not counted anymore
+lbl:set_text("x")
+
+found = false
+for _, p in ipairs(gnome.get_profile()) do
+    if p.name == "gtk_label_set_text" then
+	assert(p.calls == 10, "calls " .. p.calls)
+	assert(p.total >= p.max and p.max >= 0)
+	assert(p.conv >= 0 and p.call >= 0)
+	assert(p.callback == false)
+	found = true
+    end
+end
+assert(found)
+
+gnome.reset_profile()
+assert(#gnome.get_profile() == 0)
+
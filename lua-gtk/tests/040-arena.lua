@@ -0,0 +1,24 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Memory for output arguments is taken from a per-call arena, which must not
+-- require a malloc on each call.
+
+require "pango"
+
+ta = pango.tab_array_new_with_positions(1, true, pango.TAB_LEFT, 10)
+
+-- warm up: the arena of the call_info is allocated on first use
+a, b = ta:get_tab(0, 0, 0)
+assert(b == 10)
+
+items, bytes, blocks = gnome.get_arena_stats()
+for i = 1, 100 do
+    a, b = ta:get_tab(0, 0, 0)
+    assert(a == pango.TAB_LEFT)
+    assert(b == 10)
+end
+items2, bytes2, blocks2 = gnome.get_arena_stats()
+
+assert(items2 - items >= 200, "items " .. (items2 - items))
+assert(blocks2 == blocks, "blocks " .. (blocks2 - blocks))
+
@@ -0,0 +1,39 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Library objects are mapped to their proxy objects by a hash table in C.
+-- The same proxy must be returned for an object while it is alive, and
+-- proxies must still be garbage collected.
+
+require "gtk"
+
+box = gtk.vbox_new(false, 0)
+labels = {}
+for i = 1, 1000 do
+    labels[i] = gtk.label_new(tostring(i))
+    box:pack_start(labels[i], false, false, 0)
+end
+
+-- each child found through the library is the existing proxy object
+children = box:get_children()
+i = 0
+while children do
+    i = i + 1
+    assert(rawequal(children.data:cast "GtkLabel", labels[i]))
+    children = children.next
+end
+assert(i == 1000)
+
+-- drop the proxies; new ones are created for the same objects.
+labels = nil
+collectgarbage "collect"
+collectgarbage "collect"
+
+children = box:get_children()
+i = 0
+while children do
+    i = i + 1
+    local child = children.data:cast "GtkLabel"
+    assert(child:get_text() == tostring(i))
+    children = children.next
+end
+assert(i == 1000)
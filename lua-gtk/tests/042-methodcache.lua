@@ -0,0 +1,34 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Methods and attributes are remembered per class, including lookups that
+-- failed.  Repeated lookups must return the same results.
+
+require "gtk"
+
+entry = gtk.entry_new()
+entry2 = gtk.entry_new()
+
+for i = 1, 3 do
+    -- method of the class, of a parent class, and of an interface
+    entry:set_text("abc" .. i)
+    assert(entry:get_text() == "abc" .. i)
+    entry:show()
+    entry:set_editable(false)
+    assert(entry:get_editable() == false)
+    entry:set_editable(true)
+
+    -- structure element of a parent class (GtkObject)
+    assert(type(entry.flags) == "number")
+
+    -- unknown key: must fail every time
+    rc, msg = pcall(function() return entry.no_such_method end)
+    assert(not rc)
+    assert(string.match(msg, "not found"), msg)
+end
+
+-- a value stored by the user is found for that object only, even though the
+-- key isn't known to the class.
+entry.no_such_method = 42
+assert(entry.no_such_method == 42)
+rc, msg = pcall(function() return entry2.no_such_method end)
+assert(not rc)
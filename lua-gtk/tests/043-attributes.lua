@@ -0,0 +1,34 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Structure elements are found by a binary search in a name index that is
+-- generated for each structure.  Check the first, last and some other
+-- elements, and that unknown names are not found.
+
+require "gdk"
+
+c = gdk.new "Color"
+c.pixel = 1
+c.red = 100
+c.green = 200
+c.blue = 300
+assert(c.pixel == 1)
+assert(c.red == 100)
+assert(c.green == 200)
+assert(c.blue == 300)
+
+e = gdk.new("Event", gdk.MOTION_NOTIFY)
+m = e.motion
+m.x = 1.5
+m.y = 2.5
+m.state = 4
+m.is_hint = 1
+assert(m.x == 1.5)
+assert(m.y == 2.5)
+assert(m.state == 4)
+assert(m.is_hint == 1)
+assert(m.type == gdk.MOTION_NOTIFY)
+
+for _, name in ipairs { "a", "redd", "x_root2", "zzz", "" } do
+    rc = pcall(function() return m[name] end)
+    assert(not rc, name)
+end
@@ -0,0 +1,29 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- ENUMs are immutable; pushing the same type and value again reuses the
+-- userdata.  The GType of each ENUM type is determined only once.
+
+require "gtk"
+
+a = gtk.SORT_ASCENDING
+assert(rawequal(a, gtk.SORT_ASCENDING))
+assert(tostring(a) == "GtkSortType:GTK_SORT_ASCENDING", tostring(a))
+
+-- same value, different types: not the same userdata, and not comparable
+assert(not rawequal(gtk.STATE_NORMAL, gtk.WINDOW_TOPLEVEL))
+rc, msg = pcall(function() return gtk.STATE_NORMAL == gtk.WINDOW_TOPLEVEL end)
+assert(rc == false)
+
+-- results of flag operations are interned too
+v = gtk.CAN_DEFAULT + gtk.REALIZED
+assert(rawequal(v, gtk.REALIZED + gtk.CAN_DEFAULT))
+assert(tostring(v) == "GtkWidgetFlags:realized|can-default")
+
+-- usable as table keys
+t = { [gtk.SORT_DESCENDING] = 1 }
+assert(t[gtk.SORT_DESCENDING] == 1)
+
+-- enums returned by library functions
+col = gtk.tree_view_column_new()
+col:set_sort_order(gtk.SORT_DESCENDING)
+assert(rawequal(col:get_sort_order(), gtk.SORT_DESCENDING))
@@ -0,0 +1,41 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- In integer mode, ENUMs and FLAGS are plain numbers.
+
+require "gtk"
+
+col = gtk.tree_view_column_new()
+
+-- default: typed
+assert(type(gtk.SORT_ASCENDING) == "userdata")
+
+-- integer mode just for gtk
+assert(gnome.set_enum_mode("integer", "gtk") == "default")
+assert(type(gtk.SORT_DESCENDING) == "number")
+col:set_sort_order(gtk.SORT_DESCENDING)
+assert(col:get_sort_order() == gtk.SORT_DESCENDING)
+col:set_sort_order(0)
+assert(col:get_sort_order() == 0)
+
+-- typed values are still accepted as arguments
+gnome.set_enum_mode("default", "gtk")
+d = gtk.SORT_DESCENDING
+gnome.set_enum_mode("integer", "gtk")
+col:set_sort_order(d)
+assert(col:get_sort_order() == d:tonumber())
+
+-- structure elements
+assert(type(col.sort_order) == "number")
+
+-- back to the global mode, which is typed
+assert(gnome.set_enum_mode("default", "gtk") == "integer")
+assert(tostring(col:get_sort_order()) == "GtkSortType:GTK_SORT_DESCENDING")
+
+-- global integer mode
+assert(gnome.set_enum_mode("integer") == "typed")
+assert(type(gtk.WINDOW_TOPLEVEL) == "number")
+assert(gnome.set_enum_mode("typed") == "integer")
+assert(type(gtk.WINDOW_TOPLEVEL) == "userdata")
+
+rc, msg = pcall(gnome.set_enum_mode, "default")
+assert(not rc)
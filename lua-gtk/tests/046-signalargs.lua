@@ -0,0 +1,40 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Signal handlers get the arguments of the signal, then the extra arguments
+-- given to connect.
+
+require "gtk"
+
+-- object argument, extra arguments
+box = gtk.vbox_new(false, 0)
+lbl = gtk.label_new("x")
+added = nil
+box:connect('add', function(obj, child, a, b, c)
+    assert(obj == box)
+    added = child
+    assert(a == 1 and b == "two" and c == false)
+end, 1, "two", false)
+box:add(lbl)
+assert(added == lbl)
+
+-- an unsigned integer and a pointer
+nb = gtk.notebook_new()
+nb:append_page(gtk.label_new("a"), nil)
+nb:append_page(gtk.label_new("b"), nil)
+page_nr = nil
+nb:connect('switch-page', function(obj, page, nr, extra)
+    page_nr = nr
+    assert(extra == nil)
+end)
+nb:set_current_page(1)
+assert(page_nr == 1)
+
+-- a nil extra argument is ignored
+btn = gtk.toggle_button_new()
+count = 0
+btn:connect('toggled', function(obj, ...)
+    assert(select('#', ...) == 0)
+    count = count + 1
+end, nil)
+btn:set_active(true)
+assert(count == 1)
@@ -0,0 +1,36 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Signal handlers connected in either dispatch mode get the same arguments
+-- and can return values.
+
+require "gtk"
+
+assert(glib.signal_set_dispatch("varargs") == "closure")
+
+for _, mode in ipairs { "varargs", "closure" } do
+    glib.signal_set_dispatch(mode)
+
+    local box = gtk.vbox_new(false, 0)
+    local lbl = gtk.label_new("x")
+    local got
+    box:connect('add', function(obj, child, extra)
+	assert(obj == box)
+	got = child
+	assert(extra == mode)
+    end, mode)
+    box:add(lbl)
+    assert(got == lbl, mode)
+
+    local btn = gtk.button_new_with_mnemonic("_x")
+    local called = 0
+    btn:connect('mnemonic-activate', function(obj, group_cycling)
+	assert(group_cycling == false)
+	called = called + 1
+	return true
+    end)
+    assert(btn:mnemonic_activate(false) == true, mode)
+    assert(called == 1)
+end
+
+rc, msg = pcall(glib.signal_set_dispatch, "other")
+assert(not rc)
@@ -0,0 +1,34 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Automatic closures, i.e. Lua functions given where the library expects a
+-- function pointer, are reused after garbage collection.
+
+require "gtk"
+
+box = gtk.vbox_new(false, 0)
+for i = 1, 3 do
+    box:add(gtk.label_new(tostring(i)))
+end
+
+-- each call gets a new closure bound to a different Lua function.
+allocated, reused = gnome.get_closure_stats()
+for i = 1, 50 do
+    local seen = 0
+    box:foreach(function(child, data)
+	seen = seen + 1
+    end, nil)
+    assert(seen == 3)
+    collectgarbage "collect"
+end
+
+-- the collected closure is in the pool for the next call.
+allocated2, reused2 = gnome.get_closure_stats()
+assert(allocated2 - allocated <= 1, allocated2 - allocated)
+assert(reused2 - reused >= 49, reused2 - reused)
+
+-- some functions keep the function pointer, so this must fail.  The check
+-- is only compiled in with the debug functions.
+if gnome.set_debug_flags then
+    rc, msg = pcall(glib.tree_new, function(a, b) return 0 end)
+    assert(not rc)
+end
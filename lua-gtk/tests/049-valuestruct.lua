@@ -0,0 +1,36 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Small structures like GtkTreeIter are stored in the proxy object itself;
+-- they work like other structures, but are not entered in gnome.aliases.
+
+require "gtk"
+
+ls = gtk.list_store_new(1, glib.TYPE_INT)
+for i = 1, 100 do
+    local iter = gtk.new "TreeIter"
+    ls:append(iter)
+    ls:set_value(iter, 0, i)
+end
+
+-- fill a value object via a library function
+iter = gtk.new "TreeIter"
+assert(ls:get_iter_first(iter))
+assert(ls:get_value(iter, 0) == 1)
+assert(ls:iter_next(iter))
+assert(ls:get_value(iter, 0) == 2)
+
+for k, v in pairs(gnome.aliases) do
+    assert(v ~= iter, "value object in aliases")
+end
+
+-- fields can be read and written
+r = gdk.new "Rectangle"
+r.x, r.y, r.width, r.height = 1, 2, 30, 40
+assert(r.x == 1 and r.height == 40)
+
+-- arrays are allocated as before
+a = gtk.new_array("TreeIter", 3)
+assert(a)
+
+iter, r, a = nil, nil, nil
+collectgarbage "collect"
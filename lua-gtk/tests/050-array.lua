@@ -0,0 +1,46 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Typed array views: element access, bulk copies from and to tables and
+-- strings, and views of arrays of structures.
+
+require "gtk"
+
+a = gnome.array("gdouble", 5)
+assert(#a == 5)
+assert(a[1] == 0)
+a[2] = 1.5
+assert(a[2] == 1.5)
+rc, msg = pcall(function() return a[6] end)
+assert(not rc)
+
+a:fill(7)
+assert(a[1] == 7 and a[5] == 7)
+a:fill(0, 4, 5)
+assert(a[3] == 7 and a[4] == 0)
+
+assert(a:from_table{ 1, 2, 3 } == 3)
+t = a:slice(2, 4)
+assert(#t == 3 and t[1] == 2 and t[3] == 0)
+rc, msg = pcall(function() a:from_table({ 1, 2 }, 5) end)
+assert(not rc)
+
+-- bulk copies via strings
+b = gnome.array("gdouble", 5)
+assert(b:from_string(a:to_string()) == 5)
+assert(b[3] == 3)
+
+-- integer conversion
+i = gnome.array("guint8", { 1, 255, 7 })
+assert(#i == 3 and i[2] == 255 and i[3] == 7)
+i = gnome.array("gint16", { -1, 32767, -32768 })
+assert(i[1] == -1 and i[2] == 32767 and i[3] == -32768)
+
+-- a view of an array of structures
+pts = gtk.new_array("GdkPoint", 3)
+v = gnome.array(pts, "gint")
+assert(#v == 6)
+v:from_table{ 10, 20, 30, 40, 50, 60 }
+assert(pts[2].x == 30 and pts[3].y == 60)
+
+pts, v = nil, nil
+collectgarbage "collect"
@@ -0,0 +1,42 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Read and write several fields of a structure with one call.
+
+require "gtk"
+
+local names = { "x", "y", "width", "height" }
+
+r = gdk.new "Rectangle"
+r:set_fields(names, { 1, 2, 30, 40 })
+assert(r.x == 1 and r.y == 2 and r.width == 30 and r.height == 40)
+
+x, y, w, h = r:get_fields(names)
+assert(x == 1 and y == 2 and w == 30 and h == 40)
+
+-- nil values are skipped; the cached plan is used again
+r:set_fields(names, { nil, 5 })
+x, y, w = r:get_fields(names)
+assert(x == 1 and y == 5 and w == 30)
+
+-- changes to the table of names are noticed
+local names2 = { "x", "y" }
+x, y = r:get_fields(names2)
+names2[2] = "width"
+x, w = r:get_fields(names2)
+assert(x == 1 and w == 30)
+names2[3] = "height"
+x, w, h = r:get_fields(names2)
+assert(w == 30 and h == 40)
+
+-- unknown fields and methods are errors
+rc, msg = pcall(function() return r:get_fields{ "x", "nonexistent" } end)
+assert(not rc)
+rc, msg = pcall(function() return r:get_fields{ "get_fields" } end)
+assert(not rc)
+
+-- fields of a parent structure
+win = gtk.window_new(gtk.WINDOW_TOPLEVEL)
+alloc = win:get_fields{ "allocation" }
+a2 = win.allocation
+assert(alloc.x == a2.x and alloc.y == a2.y and alloc.width == a2.width
+    and alloc.height == a2.height)
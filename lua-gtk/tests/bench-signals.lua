@@ -0,0 +1,57 @@
+#! /usr/bin/env lua
+-- vim:sw=4:sts=4
+-- Compare the emission throughput of signal handlers connected with the
+-- two dispatch modes, see glib.signal_set_dispatch.
+--
+-- Usage: lua bench-signals.lua [emissions]
+
+require "gtk"
+
+local N = tonumber(arg and arg[1]) or 100000
+
+-- Each case connects a handler to a new object and returns a function that
+-- emits the signal once.
+local cases = {
+    -- no arguments
+    { "GtkAdjustment::value-changed", function(handler)
+	local adj = gtk.adjustment_new(0, 0, 100, 1, 10, 0)
+	adj:connect('value-changed', handler)
+	return function() adj:value_changed() end
+    end },
+
+    -- one object argument, one extra argument
+    { "GtkContainer::set-focus-child", function(handler)
+	local box = gtk.vbox_new(false, 0)
+	local lbl = gtk.label_new("x")
+	box:add(lbl)
+	box:connect('set-focus-child', handler, "extra")
+	return function() box:set_focus_child(lbl) end
+    end },
+
+    -- return value
+    { "GtkWidget::mnemonic-activate", function(handler)
+	local btn = gtk.button_new_with_mnemonic("_x")
+	btn:connect('mnemonic-activate', function() handler() return true end)
+	return function() btn:mnemonic_activate(false) end
+    end },
+}
+
+local count
+local function handler() count = count + 1 end
+
+print(string.format("%-32s %10s %12s", "signal", "mode", "emissions/s"))
+for _, case in ipairs(cases) do
+    for _, mode in ipairs { "varargs", "closure" } do
+	glib.signal_set_dispatch(mode)
+	local emit = case[2](handler)
+	count = 0
+	collectgarbage "collect"
+	local t = os.clock()
+	for i = 1, N do emit() end
+	t = os.clock() - t
+	assert(count == N, "handler called " .. count .. " times")
+	print(string.format("%-32s %10s %12.0f", case[1], mode,
+	    t > 0 and N / t or 0))
+    end
+end
+glib.signal_set_dispatch "closure"
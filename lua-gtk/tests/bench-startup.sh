@@ -0,0 +1,22 @@
+#! /bin/bash
+# Measure the time taken by require "gtk", i.e. loading the core module, gtk
+# and the modules it depends on.  Each run is a new Lua interpreter; the CPU
+# time of the require is printed for each run, then the minimum and average.
+#
+# Usage: bench-startup.sh [runs]
+#
+
+RUNS=${1:-20}
+
+# change to the directory where this script is in.
+BASEDIR="${0%/*}"
+cd "$BASEDIR"
+
+for i in $(seq $RUNS); do
+	lua -e 'local t = os.clock(); require "gtk"
+		print(string.format("%.3f", (os.clock() - t) * 1000))'
+done | awk -v runs=$RUNS '
+	{ print "run " NR ": " $1 " ms"; sum += $1;
+	  if (NR == 1 || $1 < min) min = $1 }
+	END { if (NR) printf "%d runs, min %.3f ms, average %.3f ms\n", NR,
+	  min, sum / NR }'